@@ -23,6 +23,10 @@ Camera * newCamera(int w, int h)
     camera->znear = 0.001f;
     camera->zfar = 100.0f;
 
+    /* mat4 and vec3 with std140 padding. */
+    camera->transformBuffer =
+        newUniformBuffer(20 * sizeof(GLfloat), TRANSFORM_VIEWS_CNT);
+
     return camera;
 }
 
@@ -57,20 +61,18 @@ void rotateCamera(Camera * camera, float head, float pitch, float roll)
     setMulQuaternion(camera->q, dq);
 }
 
-void setupCamera(ShaderProgram * sp, const Camera * camera)
+void setCameraProjMatrix(mat4 m, const Camera * camera)
 {
-    /* Pointers */
-    GLint viewProjP, viewPosP;
-
-    /* Matrices */
-    mat4 viewTrMatrix, viewRotMatrix, viewMatrix;
-    mat4 projMatrix, viewProjMatrix;
-
-    setPerspectiveMatrix(projMatrix,
+    setPerspectiveMatrix(m,
         camera->viewAngleY,
         camera->aspect,
         camera->znear,
         camera->zfar);
+}
+
+void setCameraViewMatrix(mat4 m, const Camera * camera)
+{
+    mat4 viewTrMatrix, viewRotMatrix;
 
     setMatrixFromQuaternion(viewRotMatrix, camera->q);
 
@@ -79,54 +81,57 @@ void setupCamera(ShaderProgram * sp, const Camera * camera)
         -camera->pos[1],
         -camera->pos[2]);
 
-    setMulMatrix(viewMatrix, viewRotMatrix, viewTrMatrix);
-
-    setMulMatrix(viewProjMatrix, projMatrix, viewMatrix);
+    setMulMatrix(m, viewRotMatrix, viewTrMatrix);
+}
 
-    glUseProgram(sp->p);
+void setupCamera(const Camera * camera)
+{
+    /* Matrices */
+    mat4 viewMatrix, projMatrix, viewProjMatrix;
 
-    viewProjP = glGetUniformLocation(sp->p, "transform.viewProjection");
-    /* TODO: if (viewProjP == -1) {} */
-    glUniformMatrix4fv(viewProjP, 1, GL_TRUE, viewProjMatrix);
+    setCameraProjMatrix(projMatrix, camera);
+    setCameraViewMatrix(viewMatrix, camera);
 
-    viewPosP = glGetUniformLocation(sp->p, "transform.viewPosition");
-    /* TODO: if (viewPosP == -1) {} */
-    glUniform3fv(viewPosP, 1, camera->pos);
+    setMulMatrix(viewProjMatrix, projMatrix, viewMatrix);
 
-#ifdef DEBUG
-    validateShaderProgram(sp->p);
-#endif
-    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+    setupTransform(camera, TRANSFORM_VIEW_CAMERA, viewProjMatrix,
+        camera->pos);
 }
 
-void setupCameraAlter(ShaderProgram * sp, const Camera * camera)
+void setupTransform(const Camera * camera, TransformView view,
+    const mat4 viewProj, const vec3 viewPos)
 {
-    /* Pointers */
-    GLint rotP, viewPosP;
+    GLfloat data[20];
+    int k;
 
-    /* Matrices */
-    mat4 rotMatrix;
+    /* Block is row_major, as our matrices. */
+    for (k = 0; k < 16; ++k)
+    {
+        data[k] = viewProj[k];
+    }
 
-    setMatrixFromQuaternion(rotMatrix, camera->q);
-    transposeMatrix(rotMatrix);
+    for (k = 0; k < 3; ++k)
+    {
+        data[16 + k] = viewPos[k];
+    }
 
-    glUseProgram(sp->p);
+    data[19] = 0.0f;
 
-    rotP = glGetUniformLocation(sp->p, "transform.rot");
-    /* TODO: if (rotP == -1) {} */
-    glUniformMatrix4fv(rotP, 1, GL_TRUE, rotMatrix);
+    setUniformBufferSlot(camera->transformBuffer, view, data);
+    bindUniformBufferSlot(camera->transformBuffer,
+        UNIFORM_BINDING_TRANSFORM, view);
 
-    viewPosP = glGetUniformLocation(sp->p, "transform.viewPosition");
-    /* TODO: if (viewPosP == -1) {} */
-    glUniform3fv(viewPosP, 1, camera->pos);
-
-#ifdef DEBUG
-    validateShaderProgram(sp->p);
-#endif
     CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
 }
 
+void useCameraTransform(const Camera * camera)
+{
+    bindUniformBufferSlot(camera->transformBuffer,
+        UNIFORM_BINDING_TRANSFORM, TRANSFORM_VIEW_CAMERA);
+}
+
 void freeCamera(Camera * camera)
 {
+    freeUniformBuffer(camera->transformBuffer);
     free(camera);
 }
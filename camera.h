@@ -5,6 +5,20 @@
 #include "matrix.h"
 #include "shaders.h"
 
+/* Slots of Transform uniform buffer: the camera and each view rendered
+ * to texture within a frame, so no slot is rewritten while it is in
+ * use. */
+typedef
+enum TransformView
+{
+    TRANSFORM_VIEW_CAMERA,
+    TRANSFORM_VIEW_MIRROR,
+    /* Six cube map faces. */
+    TRANSFORM_VIEW_ENV,
+    TRANSFORM_VIEWS_CNT = TRANSFORM_VIEW_ENV + 6
+}
+TransformView;
+
 typedef
 struct Camera
 {
@@ -19,6 +33,9 @@ struct Camera
     float aspect;
     GLclampd znear;
     GLclampd zfar;
+
+    /* Buffer of std140 Transform block, see TransformView. */
+    UniformBuffer * transformBuffer;
 }
 Camera;
 
@@ -29,9 +46,20 @@ void slideCamera(Camera * camera, float dr, float du, float df);
 
 void rotateCamera(Camera * camera, float head, float pitch, float roll);
 
-void setupCamera(ShaderProgram * sp, const Camera * camera);
+void setCameraProjMatrix(mat4 m, const Camera * camera);
+
+void setCameraViewMatrix(mat4 m, const Camera * camera);
+
+/* Writes camera slot of Transform block and binds it. Called once per
+ * frame, all programs share the block. */
+void setupCamera(const Camera * camera);
+
+/* Transform block for view not tied to camera. */
+void setupTransform(const Camera * camera, TransformView view,
+    const mat4 viewProj, const vec3 viewPos);
 
-void setupCameraAlter(ShaderProgram * sp, const Camera * camera);
+/* Binds camera slot back after setupTransform(). */
+void useCameraTransform(const Camera * camera);
 
 void freeCamera(Camera * camera);
 
@@ -1,21 +1,51 @@
 #version 330 core
 
 uniform sampler2D texGeometry;
-uniform sampler2D texPool;
-uniform sampler2D texCube;
 
-uniform vec2 meshTexStep;
+// Gradients of heights written by simulation step, they are sampled
+// instead of neighbour heights when normalMap is on.
+uniform sampler2D texNormals;
+uniform bool normalMap;
+
+// 0 -- all at full resolution, 1 -- reflection and refraction color
+// and guide to buffer reduced shadeScale times, 2 -- full resolution
+// lighting with color upsampled from reduced buffer.
+uniform int shadePass;
+uniform float shadeScale;
+uniform sampler2D texShadeColor;
+uniform sampler2D texShadeGuide;
+
+// World triangles and their hierarchy, see world_proxy.h.
+uniform samplerBuffer texProxyNodes;
+uniform samplerBuffer texProxyTris;
+uniform sampler2DArray texWorld;
+
+// Source of ray color, see WaterRays in water_env.h: 0 -- world proxy,
+// 1 -- cube map, 2 -- cube map with parallax correction by pool box.
+uniform int rays;
+uniform samplerCube texEnv;
+uniform vec3 envPos;
+uniform vec3 envBoxMin;
+uniform vec3 envBoxMax;
+
+// Planar reflection: the world rendered by camera mirrored about rest
+// plane of water, see water_mirror.h.
+uniform bool mirror;
+uniform sampler2D texMirror;
+
+// Texel size of simulation grid.
+uniform vec2 simTexStep;
 uniform vec2 meshViewFirst;
 uniform vec2 meshViewSize;
 
-uniform struct Transform
+layout(std140, row_major) uniform Transform
 {
     mat4 viewProjection;
     vec3 viewPosition;
 }
 transform;
 
-uniform struct PointLight
+layout(std140) uniform PointLight
 {
     vec3 position;
     vec4 ambient;
@@ -25,7 +55,7 @@ uniform struct PointLight
 }
 pointLight;
 
-uniform struct Material
+layout(std140) uniform Material
 {
     vec4 emission;
     vec4 ambient;
@@ -45,7 +75,9 @@ in Vertex
 }
 vertex;
 
-out vec4 color;
+layout(location = 0) out vec4 color;
+// Written only to reduced buffer.
+layout(location = 1) out vec4 guide;
 
 // Schlick's approximation a ^ b == a / (b – a * b + a)
 // a in [0.0; 1.0].
@@ -68,15 +100,6 @@ vec4 getSpecularLight(vec3 to_camera_norm, vec3 normal)
     return vertex.specular * HdotN;
 }
 
-// Is point p in rectangle with left-bottom corner x and
-// right-up corner y?
-bool inRect(vec2 p, vec2 x, vec2 y)
-{
-//    return (all(greaterThanEqual(p, x)) && all(lessThanEqual(p, y)));
-    return clamp(p, x, y) == p;
-//    return max(p, x) == min(p, y);
-}
-
 // "refract" replacement for working with some buggy drivers/videocards.
 vec3 refract_fork(vec3 I, vec3 N, float eta)
 {
@@ -96,137 +119,197 @@ float water_color_factor(float water_thickness)
     return clamp((exp(water_thickness * e / 12.5) - 1.0), 0.0, 0.5);
 }
 
-// Point of intersect vector "ray" emitted from position "pos" and
-// plane with x, y, or z == value (at idx == 0, 1 or 2).
-void intersectK(vec3 pos, vec3 ray, int idx, float value,
-    out float ak, out vec2 ap)
+// k of ray pos + rRay * k entering box (0.0 if pos is inside box),
+// 1e30 if ray misses it.
+float intersectBox(vec3 p1, vec3 p2, vec3 invRay)
 {
-    float k = (value - pos[idx]) / ray[idx];
-
-    int i1, i2;
+    vec3 k1 = (p1 - vertex.position) * invRay;
+    vec3 k2 = (p2 - vertex.position) * invRay;
+    vec3 kNear = min(k1, k2);
+    vec3 kFar = max(k1, k2);
 
-    if (idx == 1)
-    {
-        i1 = 0;
-        i2 = 2;
-    }
-    else
-    {
-        i1 = (idx + 1) % 3;
-        i2 = (idx + 2) % 3;
-    }
+    float kIn = max(max(max(kNear.x, kNear.y), kNear.z), 0.0);
+    float kOut = min(min(kFar.x, kFar.y), kFar.z);
 
-    float a = pos[i1] + ray[i1] * k;
-    float b = pos[i2] + ray[i2] * k;
-    ap = vec2(a, b);
-    ak = k;
+    return (kIn <= kOut) ? kIn : 1e30;
 }
 
-// Point of intersect vector "ray" emitted from position "pos" and
-// plane with x, y, or z == value (at idx == 0, 1 or 2).
-vec3 intersect(vec3 pos, vec3 ray, int idx, float value)
+// Moller-Trumbore: nearer hit of triangle than kHit is written to
+// kHit, triHit and barycentric uvHit.
+void intersectTriangle(int tri, vec3 rRay, inout float kHit,
+    inout int triHit, inout vec2 uvHit)
 {
-    float k = (value - pos[idx]) / ray[idx];
-    return pos + ray * k;
-}
+    vec3 p0 = texelFetch(texProxyTris, 4 * tri + 0).xyz;
+    vec3 e1 = texelFetch(texProxyTris, 4 * tri + 1).xyz - p0;
+    vec3 e2 = texelFetch(texProxyTris, 4 * tri + 2).xyz - p0;
 
-struct Rect
-{
-    int axesOrthIdx;
-    float axesValue;
-    vec2 bound_p1;
-    vec2 bound_p2;
-    vec2 texScale;
-    bool cube;
-};
-
-Rect rect[10] = Rect[10]
-(
-    Rect(0, -1.05, vec2(-1.05, -1.05), vec2(1.05, 1.05), vec2(1.0, 1.0), true),
-    Rect(0,  1.05, vec2(-1.05, -1.05), vec2(1.05, 1.05), vec2(1.0, 1.0), true),
-    Rect(1, -1.05, vec2(-1.05, -1.05), vec2(1.05, 1.05), vec2(1.0, 1.0), true),
-    Rect(1,  1.05, vec2(-1.05, -1.05), vec2(1.05, 1.05), vec2(1.0, 1.0), true),
-    Rect(2,  1.05, vec2(-1.05, -1.05), vec2(1.05, 1.05), vec2(1.0, 1.0), true),
-
-    Rect(0,  10.0, vec2(-10.0, -1.0), vec2(10.0, 1.0), vec2(10.0, 1.0), false),
-    Rect(0, -10.0, vec2(-10.0, -1.0), vec2(10.0, 1.0), vec2(10.0, 1.0), false),
-    Rect(1,  10.0, vec2(-10.0, -1.0), vec2(10.0, 1.0), vec2(10.0, 1.0), false),
-    Rect(1, -10.0, vec2(-10.0, -1.0), vec2(10.0, 1.0), vec2(10.0, 1.0), false),
-    Rect(2, -1.0, vec2(-10.0, -10.0), vec2(10.0, 10.0), vec2(10.0, 10.0), false)
-);
+    vec3 pv = cross(rRay, e2);
+    float det = dot(e1, pv);
 
-void calcRayColor(vec3 rRay, vec3 normal, out float dist, out vec4 color)
-{
-    if (rRay == vec3(0.0))
+    if (det == 0.0)
     {
-        dist = 1000.0;
-        color = vec4(0.0, 0.20, 0.40, 1.0);
         return;
     }
 
-    float lr = length(rRay);
-    float min_dist = 1000.0;
-    vec2 res_tc = vec2(0.0, 0.0);
-    bool cube = false;
-    vec4 cur_color = vec4(0.0, 0.20, 0.40, 1.0);
+    vec3 tv = vertex.position - p0;
+    vec3 qv = cross(tv, e1);
+    vec2 uv = vec2(dot(tv, pv), dot(rRay, qv)) / det;
+    float k = dot(e2, qv) / det;
 
-    for (int i = 0; i < 10; ++i)
+    if (uv.x >= 0.0 && uv.y >= 0.0 && uv.x + uv.y <= 1.0 &&
+        k > 0.0 && k < kHit)
     {
-        float k;
-        vec2 p;
+        kHit = k;
+        triHit = tri;
+        uvHit = uv;
+    }
+}
+
+// Nearest world triangle on ray, -1 if there is no one.
+int traceProxy(vec3 rRay, out float kHit, out vec2 uvHit)
+{
+    vec3 invRay = 1.0 / rRay;
+    int triHit = -1;
 
-        intersectK(vertex.position, rRay,
-            rect[i].axesOrthIdx, rect[i].axesValue, k, p);
+    // Size is WORLD_PROXY_STACK_MAX.
+    int stack[32];
+    int top = 0;
+
+    kHit = 1e30;
+    uvHit = vec2(0.0);
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        int node = stack[--top];
+        vec4 p1 = texelFetch(texProxyNodes, 2 * node + 0);
+        vec4 p2 = texelFetch(texProxyNodes, 2 * node + 1);
 
-        if (k > 0.0 && inRect(p, rect[i].bound_p1, rect[i].bound_p2))
+        // Node behind nearest hit is skipped.
+        if (intersectBox(p1.xyz, p2.xyz, invRay) >= kHit)
         {
-            vec2 texCoord = (p - rect[i].bound_p1) /
-                (rect[i].bound_p2 - rect[i].bound_p1) * rect[i].texScale;
-            float d = k * lr;
+            continue;
+        }
+
+        int a = int(p1.w);
+        int b = int(p2.w);
 
-            if (d < min_dist)
+        // Leaf, it is empty in world without textured triangles.
+        if (b >= 0)
+        {
+            for (int tri = a; tri < a + b; ++tri)
             {
-                min_dist = d;
-                res_tc = texCoord;
-                cube = rect[i].cube;
+                intersectTriangle(tri, rRay, kHit, triHit, uvHit);
             }
         }
+        else
+        {
+            // Nearer child is popped first.
+            bool lowerFirst = (rRay[-b - 1] >= 0.0);
+
+            stack[top++] = lowerFirst ? a + 1 : a;
+            stack[top++] = lowerFirst ? a : a + 1;
+        }
     }
 
-    if (min_dist < 1000.0)
+    return triHit;
+}
+
+// Layer of texWorld is Texture->num, see world_proxy.h.
+vec4 worldColor(int texIdx, vec2 tc)
+{
+    return texture(texWorld, vec3(tc, float(texIdx)));
+}
+
+// Ray leaves pool box through its walls or floor at known distance,
+// through open top -- to far world.
+void calcEnvColor(vec3 rRay, out float dist, out vec4 color)
+{
+    vec3 k1 = (envBoxMin - vertex.position) / rRay;
+    vec3 k2 = (envBoxMax - vertex.position) / rRay;
+    vec3 kFar = max(k1, k2);
+    float kOut = min(min(kFar.x, kFar.y), kFar.z);
+    vec3 dir = rRay;
+
+    if (rRay.z < 0.0 || kOut < kFar.z)
     {
-        if (cube)
-        {
-            cur_color = texture(texCube, res_tc);
-        }
-        else
+        dist = kOut * length(rRay);
+
+        if (rays == 2)
         {
-            cur_color = texture(texPool, res_tc);
+            dir = vertex.position + rRay * kOut - envPos;
         }
     }
 
-    dist = min_dist;
-    color = cur_color;
+    color = texture(texEnv, dir);
+}
+
+void calcRayColor(vec3 rRay, vec3 normal, out float dist, out vec4 color)
+{
+    dist = 1000.0;
+    color = vec4(0.0, 0.20, 0.40, 1.0);
+
+    if (rRay == vec3(0.0))
+    {
+        return;
+    }
+
+    if (rays != 0)
+    {
+        calcEnvColor(rRay, dist, color);
+        return;
+    }
+
+    float k;
+    vec2 uv;
+    int tri = traceProxy(rRay, k, uv);
+
+    if (tri != -1)
+    {
+        vec4 t0 = texelFetch(texProxyTris, 4 * tri + 0);
+        vec4 t1 = texelFetch(texProxyTris, 4 * tri + 1);
+        vec4 t2 = texelFetch(texProxyTris, 4 * tri + 2);
+        vec4 t3 = texelFetch(texProxyTris, 4 * tri + 3);
+
+        vec2 tc = vec2(t1.w, t2.w) * (1.0 - uv.x - uv.y) +
+            t3.xy * uv.x + t3.zw * uv.y;
+
+        dist = k * length(rRay);
+        color = worldColor(int(t0.w), tc);
+    }
 }
 
 // tc -- texture coordinates.
 vec3 calcNormal(vec2 tc, vec3 to_camera_norm)
 {
-    float zL = texture(texGeometry, vec2(tc.x - meshTexStep.x, tc.y)).r;
-    float zR = texture(texGeometry, vec2(tc.x + meshTexStep.x, tc.y)).r;
-    float zD = texture(texGeometry, vec2(tc.x, tc.y - meshTexStep.y)).r;
-    float zU = texture(texGeometry, vec2(tc.x, tc.y + meshTexStep.y)).r;
+    vec2 slope;
 
-    float zLL = texture(texGeometry, vec2(tc.x - meshTexStep.x * 3.0, tc.y)).r;
-    float zRR = texture(texGeometry, vec2(tc.x + meshTexStep.x * 3.0, tc.y)).r;
-    float zDD = texture(texGeometry, vec2(tc.x, tc.y - meshTexStep.y * 3.0)).r;
-    float zUU = texture(texGeometry, vec2(tc.x, tc.y + meshTexStep.y * 3.0)).r;
+    if (normalMap)
+    {
+        // Written by modify_water_fshader.glsl.
+        slope = texture(texNormals, tc).rg;
+    }
+    else
+    {
+        float zL = texture(texGeometry, vec2(tc.x - simTexStep.x, tc.y)).r;
+        float zR = texture(texGeometry, vec2(tc.x + simTexStep.x, tc.y)).r;
+        float zD = texture(texGeometry, vec2(tc.x, tc.y - simTexStep.y)).r;
+        float zU = texture(texGeometry, vec2(tc.x, tc.y + simTexStep.y)).r;
+
+        float zLL = texture(texGeometry, vec2(tc.x - simTexStep.x * 3.0, tc.y)).r;
+        float zRR = texture(texGeometry, vec2(tc.x + simTexStep.x * 3.0, tc.y)).r;
+        float zDD = texture(texGeometry, vec2(tc.x, tc.y - simTexStep.y * 3.0)).r;
+        float zUU = texture(texGeometry, vec2(tc.x, tc.y + simTexStep.y * 3.0)).r;
+
+        slope = vec2(pow(zR - zL, 2) + (zRR - zLL),
+            pow(zU - zD, 2) + (zUU - zDD));
+    }
 
-    vec3 dx = vec3(pow(2.0 * meshTexStep.x, 2) + 6.0 * meshTexStep.x, 0.0, pow(zR - zL, 2) + (zRR - zLL));
-    vec3 dy = vec3(0.0, pow(2.0 * meshTexStep.y, 2) + 6.0 * meshTexStep.y, pow(zU - zD, 2) + (zUU - zDD));
+    vec3 dx = vec3(pow(2.0 * simTexStep.x, 2) + 6.0 * simTexStep.x, 0.0, slope.x);
+    vec3 dy = vec3(0.0, pow(2.0 * simTexStep.y, 2) + 6.0 * simTexStep.y, slope.y);
 
     // Straight normal -- the water looks more gnarly (angular).
-    // vec3 normal = normalize(vec3(zL - zR, zD - zU, 2.0 * meshTexStep.x));
+    // vec3 normal = normalize(vec3(zL - zR, zD - zU, 2.0 * simTexStep.x));
 
     // This not work correctly with nouveau linux driver,
     // you can fallback to 'straight normal' defined in comment before.
@@ -240,16 +323,34 @@ vec3 calcNormal(vec2 tc, vec3 to_camera_norm)
     return normal;
 }
 
-void main(void)
+// Reflection texture at screen position of fragment shifted by tilt of
+// the surface.
+vec4 calcMirrorColor(vec3 normal)
 {
-    vec3 to_camera = transform.viewPosition - vertex.position;
-    vec3 to_camera_norm = normalize(to_camera);
+    vec4 p = transform.viewProjection * vec4(vertex.position, 1.0);
+    vec2 tc = p.xy / p.w * 0.5 + 0.5 + normal.xy * 0.05;
 
-    vec2 texCoord = (vertex.position.xy - meshViewFirst) / meshViewSize;
-    vec3 normal = calcNormal(texCoord, to_camera_norm);
+    return texture(texMirror, tc);
+}
 
-    vec4 specular_light = getSpecularLight(to_camera_norm, normal);
+// Distance of planar reflection is not known, it is 0.
+void calcReflectColor(vec3 rRay, vec3 normal, out float dist,
+    out vec4 color)
+{
+    if (mirror)
+    {
+        dist = 0.0;
+        color = calcMirrorColor(normal);
+    }
+    else
+    {
+        calcRayColor(rRay, normal, dist, color);
+    }
+}
 
+// Reflection and refraction mixed by Fresnel factor.
+vec4 calcRRColor(vec3 to_camera, vec3 to_camera_norm, vec3 normal)
+{
     vec4 waterColor = vec4(0.0, 0.20, 0.40, 1.0);
 
     vec4 refractColor;
@@ -265,7 +366,7 @@ void main(void)
         refractColor = mix(refractColor, waterColor, wf);
 
         rRay = reflect(-to_camera_norm, normal);
-        calcRayColor(rRay, normal, dist2, reflectColor);
+        calcReflectColor(rRay, normal, dist2, reflectColor);
         wf = water_color_factor(dist2);
         reflectColor = mix(reflectColor, waterColor, wf);
     }
@@ -278,7 +379,7 @@ void main(void)
         refractColor = mix(refractColor, waterColor, wf);
 
         rRay = reflect(-to_camera_norm, normal);
-        calcRayColor(rRay, normal, dist2, reflectColor);
+        calcReflectColor(rRay, normal, dist2, reflectColor);
         wf = water_color_factor(dist2 + length(to_camera));
         reflectColor = mix(reflectColor, waterColor, wf);
     }
@@ -290,8 +391,72 @@ void main(void)
 //    else
         frenel = 1.0 / pow(1.0 + dot(to_camera_norm, normal), 8.0);
 
-    vec4 rrColor = mix(refractColor, reflectColor, frenel);
-    waterColor = rrColor;
+    return mix(refractColor, reflectColor, frenel);
+}
+
+// Color of reduced buffer at this fragment: bilinear taps are weighted
+// by similarity of normal and distance to camera, so colors of other
+// waves and of water behind do not leak in. false -- no similar tap.
+bool upsampleRRColor(vec3 normal, float dist, out vec4 rrColor)
+{
+    vec2 p = gl_FragCoord.xy / shadeScale - 0.5;
+    ivec2 base = ivec2(floor(p));
+    vec2 f = p - vec2(base);
+    ivec2 texelMax = textureSize(texShadeColor, 0) - ivec2(1);
+    float weightSum = 0.0;
+
+    rrColor = vec4(0.0);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 texel = clamp(base + offset, ivec2(0), texelMax);
+        vec4 tap = texelFetch(texShadeGuide, texel, 0);
+        vec2 b = mix(1.0 - f, f, vec2(offset));
+
+        // Empty texel has zero normal.
+        float weight = (b.x * b.y + 1e-3) *
+            pow(max(dot(normal, tap.xyz), 0.0), 16.0) *
+            max(1.0 - abs(tap.w - dist) / (0.1 * dist), 0.0);
+
+        rrColor += weight * texelFetch(texShadeColor, texel, 0);
+        weightSum += weight;
+    }
+
+    if (weightSum < 1e-4)
+    {
+        return false;
+    }
+
+    rrColor /= weightSum;
+    return true;
+}
+
+void main(void)
+{
+    vec3 to_camera = transform.viewPosition - vertex.position;
+    vec3 to_camera_norm = normalize(to_camera);
+
+    vec2 texCoord = (vertex.position.xy - meshViewFirst) / meshViewSize;
+    vec3 normal = calcNormal(texCoord, to_camera_norm);
+
+    vec4 rrColor;
+
+    if (shadePass == 1)
+    {
+        color = calcRRColor(to_camera, to_camera_norm, normal);
+        guide = vec4(normal, length(to_camera));
+        return;
+    }
+
+    // Silhouettes without similar taps are shaded in full.
+    if (shadePass == 0 ||
+        !upsampleRRColor(normal, length(to_camera), rrColor))
+    {
+        rrColor = calcRRColor(to_camera, to_camera_norm, normal);
+    }
+
+    vec4 specular_light = getSpecularLight(to_camera_norm, normal);
 
-    color = (vertex.light + specular_light) * waterColor;
+    color = (vertex.light + specular_light) * rrColor;
 }
@@ -2,20 +2,29 @@
 
 in vec3 position;
 
-uniform vec2 meshTexStep;
+// Texel size of simulation grid.
+uniform vec2 simTexStep;
 uniform vec2 meshViewFirst;
 uniform vec2 meshViewSize;
 
+// Heights are stored relative to meshZ (for precision of 16-bit
+// formats).
+uniform float meshZ;
+
 uniform sampler2D texGeometry;
 
-uniform struct Transform
+// See draw_water_fshader.glsl.
+uniform sampler2D texNormals;
+uniform bool normalMap;
+
+layout(std140, row_major) uniform Transform
 {
     mat4 viewProjection;
     vec3 viewPosition;
 }
 transform;
 
-uniform struct PointLight
+layout(std140) uniform PointLight
 {
     vec3 position;
     vec4 ambient;
@@ -25,7 +34,7 @@ uniform struct PointLight
 }
 pointLight;
 
-uniform struct Material
+layout(std140) uniform Material
 {
     vec4 emission;
     vec4 ambient;
@@ -72,7 +81,7 @@ vec4 calcLight(vec3 real_normal, vec3 to_camera_norm)
 float calcZ(vec2 xy)
 {
     vec2 tc = (xy - meshViewFirst) / meshViewSize;
-    float z = texture(texGeometry, tc).r;
+    float z = meshZ + texture(texGeometry, tc).r;
 
     return z;
 }
@@ -80,7 +89,7 @@ float calcZ(vec2 xy)
 vec4 calcPosition(vec2 xy, out vec2 texCoord)
 {
     vec2 tc = (xy - meshViewFirst) / meshViewSize;
-    float z = texture(texGeometry, tc).r;
+    float z = meshZ + texture(texGeometry, tc).r;
 
     texCoord = tc;
     return vec4(xy, z, 1.0);
@@ -90,13 +99,13 @@ vec4 calcPosition(vec2 xy, out vec2 texCoord)
 // tc -- texture coordinates.
 vec3 calcNormal(vec2 tc, vec3 to_camera_norm)
 {
-    float zL = texture(texGeometry, vec2(tc.x - meshTexStep.x, tc.y)).r;
-    float zR = texture(texGeometry, vec2(tc.x + meshTexStep.x, tc.y)).r;
-    float zD = texture(texGeometry, vec2(tc.x, tc.y - meshTexStep.y)).r;
-    float zU = texture(texGeometry, vec2(tc.x, tc.y + meshTexStep.y)).r;
+    float zL = texture(texGeometry, vec2(tc.x - simTexStep.x, tc.y)).r;
+    float zR = texture(texGeometry, vec2(tc.x + simTexStep.x, tc.y)).r;
+    float zD = texture(texGeometry, vec2(tc.x, tc.y - simTexStep.y)).r;
+    float zU = texture(texGeometry, vec2(tc.x, tc.y + simTexStep.y)).r;
 
-    vec3 dx = vec3(2.0 * meshTexStep.x, 0.0, zR - zL);
-    vec3 dy = vec3(0.0, 2.0 * meshTexStep.y, zU - zD);
+    vec3 dx = vec3(2.0 * simTexStep.x, 0.0, zR - zL);
+    vec3 dy = vec3(0.0, 2.0 * simTexStep.y, zU - zD);
 
     //vec3 normal = normalize(vec3(zL - zR, zD - zU, 2.0 * texStep.x));
     vec3 normal = normalize(cross(dx, dy));
@@ -113,18 +122,31 @@ vec3 calcNormal(vec2 tc, vec3 to_camera_norm)
 // tc -- texture coordinates.
 vec3 calcNormal(vec2 tc, vec3 to_camera_norm)
 {
-    float zL = texture(texGeometry, vec2(tc.x - meshTexStep.x, tc.y)).r;
-    float zR = texture(texGeometry, vec2(tc.x + meshTexStep.x, tc.y)).r;
-    float zD = texture(texGeometry, vec2(tc.x, tc.y - meshTexStep.y)).r;
-    float zU = texture(texGeometry, vec2(tc.x, tc.y + meshTexStep.y)).r;
-
-    float zLL = texture(texGeometry, vec2(tc.x - meshTexStep.x*3, tc.y)).r;
-    float zRR = texture(texGeometry, vec2(tc.x + meshTexStep.x*3, tc.y)).r;
-    float zDD = texture(texGeometry, vec2(tc.x, tc.y - meshTexStep.y*3)).r;
-    float zUU = texture(texGeometry, vec2(tc.x, tc.y + meshTexStep.y*3)).r;
-
-    vec3 dx = vec3(pow(2.0 * meshTexStep.x, 2) + 6.0 * meshTexStep.x, 0.0, pow(zR - zL, 2) + (zRR - zLL));
-    vec3 dy = vec3(0.0, pow(2.0 * meshTexStep.y, 2) + 6.0 * meshTexStep.y, pow(zU - zD, 2) + (zUU - zDD));
+    vec2 slope;
+
+    if (normalMap)
+    {
+        // Written by modify_water_fshader.glsl.
+        slope = texture(texNormals, tc).rg;
+    }
+    else
+    {
+        float zL = texture(texGeometry, vec2(tc.x - simTexStep.x, tc.y)).r;
+        float zR = texture(texGeometry, vec2(tc.x + simTexStep.x, tc.y)).r;
+        float zD = texture(texGeometry, vec2(tc.x, tc.y - simTexStep.y)).r;
+        float zU = texture(texGeometry, vec2(tc.x, tc.y + simTexStep.y)).r;
+
+        float zLL = texture(texGeometry, vec2(tc.x - simTexStep.x*3, tc.y)).r;
+        float zRR = texture(texGeometry, vec2(tc.x + simTexStep.x*3, tc.y)).r;
+        float zDD = texture(texGeometry, vec2(tc.x, tc.y - simTexStep.y*3)).r;
+        float zUU = texture(texGeometry, vec2(tc.x, tc.y + simTexStep.y*3)).r;
+
+        slope = vec2(pow(zR - zL, 2) + (zRR - zLL),
+            pow(zU - zD, 2) + (zUU - zDD));
+    }
+
+    vec3 dx = vec3(pow(2.0 * simTexStep.x, 2) + 6.0 * simTexStep.x, 0.0, slope.x);
+    vec3 dy = vec3(0.0, pow(2.0 * simTexStep.y, 2) + 6.0 * simTexStep.y, slope.y);
 
     // Straight normal -- the water looks more gnarly (angular).
     // vec3 normal = normalize(vec3(zL - zR, zD - zU, 2.0 * texStep.x));
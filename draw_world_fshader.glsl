@@ -2,14 +2,14 @@
 
 uniform sampler2D texSampler;
 
-uniform struct Transform
+layout(std140, row_major) uniform Transform
 {
     mat4 viewProjection;
     vec3 viewPosition;
 }
 transform;
 
-uniform struct PointLight
+layout(std140) uniform PointLight
 {
     vec3 position;
     vec4 ambient;
@@ -19,7 +19,7 @@ uniform struct PointLight
 }
 pointLight;
 
-uniform struct Material
+layout(std140) uniform Material
 {
     vec4 emission;
     vec4 ambient;
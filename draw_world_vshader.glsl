@@ -4,14 +4,14 @@ in vec3 position;
 in vec2 texCoord;
 in vec3 normal;
 
-uniform struct Transform
+layout(std140, row_major) uniform Transform
 {
     mat4 viewProjection;
     vec3 viewPosition;
 }
 transform;
 
-uniform struct PointLight
+layout(std140) uniform PointLight
 {
     vec3 position;
     vec4 ambient;
@@ -21,7 +21,7 @@ uniform struct PointLight
 }
 pointLight;
 
-uniform struct Material
+layout(std140) uniform Material
 {
     vec4 emission;
     vec4 ambient;
@@ -35,8 +35,16 @@ material;
 uniform vec2 meshViewFirst;
 uniform vec2 meshViewSize;
 
+// Heights are stored relative to meshZ (for precision of 16-bit
+// formats).
+uniform float meshZ;
+
 uniform sampler2D texGeometry;
 
+// Camera is mirrored about rest plane of water (planar reflection), so
+// real camera is on other side of water.
+uniform bool mirrored;
+
 out Vertex
 {
     flat vec3 normal;
@@ -78,7 +86,7 @@ vec4 calcLight(vec3 real_normal, vec3 to_camera)
 float calcZ(vec2 xy)
 {
     vec2 tc = (xy - meshViewFirst) / meshViewSize;
-    float z = texture(texGeometry, tc).r;
+    float z = meshZ + texture(texGeometry, tc).r;
 
     return z;
 }
@@ -99,8 +107,14 @@ void main(void)
     vertex.light = calcLight(real_normal, to_camera);
     vertex.texCoord = texCoord;
 
-    vertex.under = transform.viewPosition.z -
-        calcZ(transform.viewPosition.xy);
+    vec3 viewPosition = transform.viewPosition;
+
+    if (mirrored)
+    {
+        viewPosition.z = 2.0 * meshZ - viewPosition.z;
+    }
+
+    vertex.under = viewPosition.z - calcZ(viewPosition.xy);
 
     gl_Position = transform.viewProjection * vec4(position, 1.0);
 }
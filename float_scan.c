@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <float.h>
+#include <limits.h>
+#include "float_scan.h"
+
+/* Mantissa is accumulated in unsigned long, up to 15 digits it is also
+ * exact in double. */
+#if ULONG_MAX > 0xFFFFFFFFUL
+#define FAST_DIGITS_MAX 15
+#else
+#define FAST_DIGITS_MAX 9
+#endif
+
+/* 2^53: integers below it are exact in double. */
+#define EXACT_INT_LIMIT 9007199254740992.0
+
+/* Powers of ten up to 10^22 are exact in double. */
+#define FAST_EXP_MAX 22
+
+/* m / 10^k is rounded twice (to double, then to float). It can go
+ * wrong only if the exact quotient is within 2^-53 of a midpoint between
+ * floats, but distance from such midpoint is at least 2^-28 relative
+ * while 10^k < 2^28, so k <= 8. */
+#define FAST_EXP_MIN -8
+
+/* Clamp of exponent, larger is out of float range anyway. */
+#define EXP_LIMIT 100000
+
+/* Extended precision of double operations (x87) breaks the reasoning
+ * above. <float.h> has no FLT_EVAL_METHOD in C89 mode, so macro of the
+ * compiler is checked too. */
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD != 0
+#define FAST_PATH 0
+#elif defined(__FLT_EVAL_METHOD__) && __FLT_EVAL_METHOD__ != 0
+#define FAST_PATH 0
+#else
+#define FAST_PATH 1
+#endif
+
+static const double powersOf10[FAST_EXP_MAX + 1] =
+{
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/* Number is rewritten as "[-]digitsEexp": without decimal point strtof()
+ * does not depend on locale. */
+static int scanFloatSlow(const char * str, int length, int negative,
+    int exp10, float * f)
+{
+    char * buf = (char *) malloc(length + 16);
+    char * q = buf;
+    const char * p;
+    char * endp;
+    int ok;
+
+    if (negative)
+    {
+        *q++ = '-';
+    }
+
+    for (p = str; p < str + length && *p != 'e' && *p != 'E'; ++p)
+    {
+        if (isDigit(*p))
+        {
+            *q++ = *p;
+        }
+    }
+
+    sprintf(q, "e%d", exp10);
+
+    errno = 0;
+    *f = strtof(buf, &endp);
+    ok = (errno == 0 && *endp == '\0');
+
+    free(buf);
+
+    return ok;
+}
+
+int scanFloat(const char * str, int length, float * f)
+{
+    const char * p = str;
+    const char * end = str + length;
+    int negative;
+    int point = 0;
+    int digitCnt = 0;
+    int fracCnt = 0;
+    int exp10 = 0;
+    unsigned long m = 0;
+    double value;
+
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    /* Signs are mixed in worlds, branch would be mispredicted. */
+    negative = (*p == '-');
+    p += (negative || *p == '+');
+
+    /* One loop for integer and fractional part: exit of a loop is
+     * mispredicted branch, numbers differ in length. Leading zeros are
+     * counted as digits too, it is only a bit more often slow path. */
+    for (; p < end; ++p)
+    {
+        unsigned int d = (unsigned char) *p - '0';
+
+        if (d < 10)
+        {
+            m = m * 10 + d;
+            ++digitCnt;
+            fracCnt += point;
+        }
+        else if (*p == '.' && ! point)
+        {
+            point = 1;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (digitCnt == 0)
+    {
+        return 0;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        int expNegative = 0;
+
+        ++p;
+
+        if (p < end && (*p == '+' || *p == '-'))
+        {
+            expNegative = (*p == '-');
+            ++p;
+        }
+
+        if (p == end || ! isDigit(*p))
+        {
+            return 0;
+        }
+
+        for (; p < end && isDigit(*p); ++p)
+        {
+            if (exp10 < EXP_LIMIT)
+            {
+                exp10 = exp10 * 10 + (*p - '0');
+            }
+        }
+
+        if (expNegative)
+        {
+            exp10 = -exp10;
+        }
+    }
+
+    if (p != end)
+    {
+        return 0;
+    }
+
+    exp10 -= fracCnt;
+
+    /* Mantissa can be overflowed. */
+    if (! FAST_PATH || digitCnt > FAST_DIGITS_MAX)
+    {
+        return scanFloatSlow(str, length, negative, exp10, f);
+    }
+
+    if (exp10 < FAST_EXP_MIN || exp10 > FAST_EXP_MAX)
+    {
+        return scanFloatSlow(str, length, negative, exp10, f);
+    }
+
+    if (exp10 >= 0)
+    {
+        /* Exact, if less than 2^53: then rounding to float is the only
+         * one. */
+        value = (double) m * powersOf10[exp10];
+
+        if (value >= EXACT_INT_LIMIT)
+        {
+            return scanFloatSlow(str, length, negative, exp10, f);
+        }
+    }
+    else
+    {
+        value = (double) m / powersOf10[-exp10];
+    }
+
+    *f = (float) (negative ? -value : value);
+
+    return 1;
+}
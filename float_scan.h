@@ -0,0 +1,16 @@
+#ifndef FLOAT_SCAN_H_SENTRY
+#define FLOAT_SCAN_H_SENTRY
+
+/* Decimal number to float without strtof() on common path: does not
+ * depend on locale, does not need null-terminated string, result is
+ * the same as of correctly rounding strtof().
+ *
+ * Syntax: [+-]digits[.[digits]][(e|E)[+-]digits], digits before or
+ * after the point can be omitted, but not both. No spaces, hex, "inf",
+ * "nan". */
+
+/* Returns 1 and sets *f, if whole string of length is a number, which
+ * fits into float; 0 otherwise. */
+int scanFloat(const char * str, int length, float * f);
+
+#endif /* FLOAT_SCAN_H_SENTRY */
@@ -13,6 +13,23 @@
 #define ROTATE_STEP 1.0f
 #define BASE_FPS 60.0f
 
+/* Limits for F3-F6 (simulation grid and render mesh size). */
+#define WATER_SIZE_MIN 16
+#define WATER_SIM_SIZE_MAX 4096
+#define WATER_MESH_SIZE_MAX 1024
+
+/* Rain for F10: off, light, heavy (for stress tests). */
+#define RAIN_DROPS_LIGHT 2000.0f
+#define RAIN_DROPS_HEAVY 20000.0f
+#define RAIN_DROP_RADIUS 0.4f
+#define RAIN_SEED 1u
+
+/* F12 cycles scale of reflection and refraction buffer: 1, 2, ... max. */
+#define WATER_SHADE_SCALE_MAX 4
+
+/* F1 cycles scale of planar reflection texture: off, 1, 2, ... max. */
+#define WATER_MIRROR_SCALE_MAX 4
+
 /* ==== Globals ==== */
 
 typedef
@@ -50,19 +67,6 @@ void windowResizeCallback(GLFWwindow * window, int w, int h)
         ((float) globals->scene->context->w) /
         ((float) globals->scene->context->h);
 
-    if (globals->scene->world != NULL)
-    {
-        setupCamera(globals->scene->world->sp, globals->scene->camera);
-    }
-
-    if (globals->scene->water != NULL)
-    {
-        setupCameraAlter(globals->scene->water->modifySP,
-            globals->scene->camera);
-        setupCamera(globals->scene->water->drawSP,
-            globals->scene->camera);
-    }
-
     glViewport(0, 0, w, h);
 }
 
@@ -70,6 +74,7 @@ void keyboardCallback(GLFWwindow * window, int key, int scancode,
     int action, int mods)
 {
     BuriedGlobals * globals = (BuriedGlobals *) glfwGetWindowUserPointer(window);
+    Water * water = globals->scene->water;
 
     UNUSED(scancode);
     UNUSED(mods);
@@ -79,6 +84,95 @@ void keyboardCallback(GLFWwindow * window, int key, int scancode,
         globals->pause = !globals->pause;
     }
 
+    if (key == GLFW_KEY_F1 && action == GLFW_PRESS)
+    {
+        int scale = globals->scene->mirror->scale;
+
+        scale = (scale == 0) ? 1 :
+            ((scale < WATER_MIRROR_SCALE_MAX) ? scale * 2 : 0);
+        setWaterMirrorScale(water->drawSP, globals->scene->mirror, scale);
+    }
+
+    if (key == GLFW_KEY_F2 && action == GLFW_PRESS)
+    {
+        setWaterEnvRays(water->drawSP, globals->scene->env,
+            (WaterRays) ((globals->scene->env->rays + 1) % WATER_RAYS_CNT));
+    }
+
+    if (key == GLFW_KEY_F3 && action == GLFW_PRESS &&
+        water->data->w / 2 >= WATER_SIZE_MIN)
+    {
+        setWaterMeshSize(water, water->data->w / 2, water->data->h / 2);
+    }
+
+    if (key == GLFW_KEY_F4 && action == GLFW_PRESS &&
+        water->data->w * 2 <= WATER_MESH_SIZE_MAX)
+    {
+        setWaterMeshSize(water, water->data->w * 2, water->data->h * 2);
+    }
+
+    if (key == GLFW_KEY_F5 && action == GLFW_PRESS &&
+        water->simW / 2 >= WATER_SIZE_MIN)
+    {
+        setWaterSimSize(water, water->simW / 2, water->simH / 2);
+    }
+
+    if (key == GLFW_KEY_F6 && action == GLFW_PRESS &&
+        water->simW * 2 <= WATER_SIM_SIZE_MAX)
+    {
+        setWaterSimSize(water, water->simW * 2, water->simH * 2);
+    }
+
+    if (key == GLFW_KEY_F7 && action == GLFW_PRESS)
+    {
+        setWaterFormat(water,
+            (WaterFormat) ((water->format + 1) % WATER_FORMATS_CNT));
+    }
+
+    if (key == GLFW_KEY_V && action == GLFW_PRESS)
+    {
+        World * world = globals->scene->world;
+
+        setWorldVertexFormat(world, (WorldVertexFormat)
+            ((world->geometry.format + 1) % WORLD_VERTEX_FORMATS_CNT));
+    }
+
+    if (key == GLFW_KEY_F9 && action == GLFW_PRESS)
+    {
+        setWaterSparse(water, !water->sparse);
+    }
+
+    if (key == GLFW_KEY_F10 && action == GLFW_PRESS)
+    {
+        float drops = water->rain.dropsPerSecond;
+
+        if (drops == 0.0f)
+        {
+            drops = RAIN_DROPS_LIGHT;
+        }
+        else if (drops == RAIN_DROPS_LIGHT)
+        {
+            drops = RAIN_DROPS_HEAVY;
+        }
+        else
+        {
+            drops = 0.0f;
+        }
+
+        setWaterRain(water, drops, RAIN_DROP_RADIUS, RAIN_SEED);
+    }
+
+    if (key == GLFW_KEY_F11 && action == GLFW_PRESS)
+    {
+        setWaterNormalMap(water, !water->normalMap);
+    }
+
+    if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
+    {
+        setWaterShadeScale(water, (water->shade.scale < WATER_SHADE_SCALE_MAX) ?
+            water->shade.scale * 2 : 1);
+    }
+
     if (key == GLFW_KEY_F8 && action == GLFW_PRESS)
     {
         globals->vsync = !globals->vsync;
@@ -104,7 +198,7 @@ void mouseButtonCallback(GLFWwindow * window, int button, int action,
     if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS &&
         !globals->pause)
     {
-        setWaterWave(globals->scene->water);
+        setWaterWave(globals->scene->water, globals->scene->camera);
     }
 }
 
@@ -112,7 +206,6 @@ void processKeyboardEvents(GLFWwindow * window, float factor)
 {
     BuriedGlobals * globals = (BuriedGlobals *) glfwGetWindowUserPointer(window);
 
-    int cameraModified = 0;
     float slide = SLIDE_STEP * factor;
     float rotate = ROTATE_STEP * factor;
 
@@ -124,86 +217,61 @@ void processKeyboardEvents(GLFWwindow * window, float factor)
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
     {
         slideCamera(globals->scene->camera, 0.0f, 0.0f, -slide);
-        cameraModified = 1;
     }
 
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
     {
         slideCamera(globals->scene->camera, 0.0f, 0.0f, slide);
-        cameraModified = 1;
     }
 
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
     {
         slideCamera(globals->scene->camera, -slide, 0.0f, 0.0f);
-        cameraModified = 1;
     }
 
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
     {
         slideCamera(globals->scene->camera, slide, 0.0f, 0.0f);
-        cameraModified = 1;
     }
 
     if (glfwGetKey(window, GLFW_KEY_PAGE_UP) == GLFW_PRESS)
     {
         slideCamera(globals->scene->camera, 0.0f, slide, 0.0f);
-        cameraModified = 1;
     }
 
     if (glfwGetKey(window, GLFW_KEY_PAGE_DOWN) == GLFW_PRESS)
     {
         slideCamera(globals->scene->camera, 0.0f, -slide, 0.0f);
-        cameraModified = 1;
     }
 
     if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
     {
         rotateCamera(globals->scene->camera, 0.0f, -rotate, 0.0f);
-        cameraModified = 1;
     }
 
     if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
     {
         rotateCamera(globals->scene->camera, 0.0f, rotate, 0.0f);
-        cameraModified = 1;
     }
 
     if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
     {
         rotateCamera(globals->scene->camera, rotate, 0.0f, 0.0f);
-        cameraModified = 1;
     }
 
     if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
     {
         rotateCamera(globals->scene->camera, -rotate, 0.0f, 0.0f);
-        cameraModified = 1;
     }
 
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
     {
         rotateCamera(globals->scene->camera, 0.0, 0.0f, rotate);
-        cameraModified = 1;
     }
 
     if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
     {
         rotateCamera(globals->scene->camera, 0.0f, 0.0f, -rotate);
-        cameraModified = 1;
-    }
-
-    if (cameraModified && globals->scene->world != NULL)
-    {
-        setupCamera(globals->scene->world->sp, globals->scene->camera);
-    }
-
-    if (cameraModified && globals->scene->water != NULL)
-    {
-        setupCameraAlter(globals->scene->water->modifySP,
-            globals->scene->camera);
-        setupCamera(globals->scene->water->drawSP,
-            globals->scene->camera);
     }
 }
 
@@ -252,19 +320,6 @@ void processMouseEvents(GLFWwindow * window, float factor)
         rotateCamera(globals->scene->camera, 0.0f, -dy, 0.0f);
     }
 
-    if (globals->scene->world != NULL)
-    {
-        setupCamera(globals->scene->world->sp, globals->scene->camera);
-    }
-
-    if (globals->scene->water != NULL)
-    {
-        setupCameraAlter(globals->scene->water->modifySP,
-            globals->scene->camera);
-        setupCamera(globals->scene->water->drawSP,
-            globals->scene->camera);
-    }
-
     glfwSetCursorPos(window, cx, cy);
 }
 
@@ -283,32 +338,98 @@ void draw(const Scene * scene)
 {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    setupCamera(scene->camera);
+
+    updateWaterEnv(scene->env, scene->world, scene->camera);
+    updateWaterMirror(scene->mirror, scene->world, scene->water,
+        scene->camera);
+
     drawWorld(scene->world);
     drawWater(scene->water);
 }
 
-void viewFps(int frameCnt, float diffSum, const BuriedGlobals * globals)
+/* stepCnt -- simulation steps made in frameCnt frames, stepMax -- maximal
+ * count of steps made in one frame. */
+void viewFps(int frameCnt, float diffSum, int stepCnt, int stepMax,
+    const BuriedGlobals * globals)
 {
-    static char title[64];
+    static char title[384];
+    static char tiles[32];
+    static char rain[32];
+    static char mirror[32];
+    const Water * water = globals->scene->water;
+    World * world = globals->scene->world;
+    const char * state;
     float fps = frameCnt / diffSum;
 
     if (globals->vsync && globals->pause)
     {
-        sprintf(title, "Wave Simulation; FPS: %0.0f [vsync, paused]", fps);
+        state = " [vsync, paused]";
     }
     else if (globals->vsync)
     {
-        sprintf(title, "Wave Simulation; FPS: %0.0f [vsync]", fps);
+        state = " [vsync]";
     }
     else if (globals->pause)
     {
-        sprintf(title, "Wave Simulation; FPS: %0.0f [paused]", fps);
+        state = " [paused]";
+    }
+    else
+    {
+        state = "";
+    }
+
+    if (water->sparse)
+    {
+        sprintf(tiles, "%d/%d", water->tiles.activeCnt,
+            water->tiles.w * water->tiles.h);
     }
     else
     {
-        sprintf(title, "Wave Simulation; FPS: %0.0f", fps);
+        sprintf(tiles, "off");
     }
 
+    if (water->rain.dropsPerSecond > 0.0f)
+    {
+        sprintf(rain, "; rain %0.0f drops/s", water->rain.dropsPerSecond);
+    }
+    else
+    {
+        rain[0] = '\0';
+    }
+
+    if (globals->scene->mirror->scale > 0)
+    {
+        sprintf(mirror, "1/%d (%0.2f ms)", globals->scene->mirror->scale,
+            globals->scene->mirror->drawSeconds * 1000.0f);
+    }
+    else
+    {
+        sprintf(mirror, "off");
+    }
+
+    sprintf(title, "Wave Simulation; FPS: %0.0f; steps/frame: %0.2f "
+        "(max %d); sim %dx%d %s (%d KB)%s; active tiles %s%s; mesh %dx%d; "
+        "normals %s; rays %s; mirror %s; water draw %0.2f ms "
+        "(shade 1/%d); world %s %d KB, draws %d, state changes %d "
+        "(%d skipped)%s",
+        fps, (float) stepCnt / frameCnt, stepMax, water->simW, water->simH,
+        getWaterFormatName(water->format),
+        getWaterTexturesBytes(water) / 1024,
+        water->sleeping ? " sleeping" : "", tiles, rain,
+        water->data->w, water->data->h,
+        water->normalMap ? "map" : "per pixel",
+        getWaterRaysName(globals->scene->env->rays), mirror,
+        water->drawSeconds * 1000.0f,
+        water->shade.scale,
+        getWorldVertexFormatName(world->geometry.format),
+        (int) ((world->geometry.vertexBytes + world->geometry.idxBytes) /
+        1024), world->stats.drawCnt / frameCnt,
+        world->stats.changeCnt / frameCnt, world->stats.skipCnt / frameCnt,
+        state);
+
+    resetWorldDrawStats(world);
+
     glfwSetWindowTitle(globals->scene->context->window, title);
 }
 
@@ -319,6 +440,8 @@ int main()
     BuriedGlobals * globals = newBuriedGlobals();
 
     int frameCnt = 0;
+    int stepCnt = 0;
+    int stepMax = 0;
     struct timeval curTime;
     float dSecond = 0;
     float dSecondSum = 0; /* droped if more than 0.5 sec */
@@ -348,14 +471,23 @@ int main()
 
         if (dSecondSum > 0.5f)
         {
-            viewFps(frameCnt, dSecondSum, globals);
+            viewFps(frameCnt, dSecondSum, stepCnt, stepMax, globals);
             frameCnt = 0;
+            stepCnt = 0;
+            stepMax = 0;
             dSecondSum = 0.0f;
         }
 
         if (!globals->pause)
         {
             modifyWaterMesh(globals->scene->water, dSecond);
+
+            stepCnt += globals->scene->water->stepCnt;
+
+            if (globals->scene->water->stepCnt > stepMax)
+            {
+                stepMax = globals->scene->water->stepCnt;
+            }
         }
 
         draw(globals->scene);
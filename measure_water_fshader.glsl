@@ -0,0 +1,54 @@
+#version 330 core
+
+uniform sampler2D texDst;
+uniform sampler2D texSnd;
+
+// Texel is (height, velocity), texSnd is not used.
+uniform bool packedVelocity;
+
+uniform int tileSize;
+
+layout(location = 0) out vec4 outFragData;
+
+// Activity of tile: max of |velocity| and |mean of neighbours - height|
+// of its texels. Step changes height by at most sum of them, so flat
+// water (at any level) without velocity is quiet.
+void main(void)
+{
+    ivec2 texelMax = textureSize(texDst, 0) - ivec2(1);
+    ivec2 first = ivec2(gl_FragCoord.xy) * tileSize;
+    float activity = 0.0;
+
+    for (int y = 0; y < tileSize; ++y)
+    {
+        for (int x = 0; x < tileSize; ++x)
+        {
+            ivec2 texel = min(first + ivec2(x, y), texelMax);
+            vec4 dst = texelFetch(texDst, texel, 0);
+            float v;
+
+            float zL = texelFetch(texDst,
+                ivec2(max(texel.x - 1, 0), texel.y), 0).r;
+            float zR = texelFetch(texDst,
+                ivec2(min(texel.x + 1, texelMax.x), texel.y), 0).r;
+            float zD = texelFetch(texDst,
+                ivec2(texel.x, max(texel.y - 1, 0)), 0).r;
+            float zU = texelFetch(texDst,
+                ivec2(texel.x, min(texel.y + 1, texelMax.y)), 0).r;
+
+            if (packedVelocity)
+            {
+                v = dst.g;
+            }
+            else
+            {
+                v = dst.r - texelFetch(texSnd, texel, 0).r;
+            }
+
+            activity = max(activity, max(abs(v),
+                abs((zL + zR + zD + zU) / 4.0 - dst.r)));
+        }
+    }
+
+    outFragData = vec4(activity, 0.0, 0.0, 0.0);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+// Size of tiles grid.
+uniform vec2 tilesSize;
+
+// Tile of simulation grid (in tiles), one point for each.
+in ivec2 tile;
+
+void main(void)
+{
+    gl_Position = vec4((vec2(tile) + 0.5) / tilesSize * 2.0 - 1.0,
+        1.0, 1.0);
+}
@@ -1,22 +1,21 @@
 #include <stdlib.h>
-#include <GL/glew.h>
 #include "mesh.h"
 
 /* w, h - count of vertices in horizontal/vertical line. */
-GLfloat * meshGenVertices(const MeshData * data)
+float * meshGenVertices(const MeshData * data)
 {
-    GLfloat stepX = (data->lastX - data->firstX) / (data->w - 1);
-    GLfloat stepY = (data->lastY - data->firstY) / (data->h - 1);
+    float stepX = (data->lastX - data->firstX) / (data->w - 1);
+    float stepY = (data->lastY - data->firstY) / (data->h - 1);
 
     int w = data->w;
     int h = data->h;
-    GLfloat z = data->z;
+    float z = data->z;
 
     int x, y;
 
-    GLfloat * mesh = (GLfloat *) malloc(3 * w * h * sizeof(GLfloat));
+    float * mesh = (float *) malloc(3 * w * h * sizeof(float));
 
-    GLsizei base = 0;
+    int base = 0;
 
     for (y = 0; y < h; ++y)
     {
@@ -33,16 +32,16 @@ GLfloat * meshGenVertices(const MeshData * data)
     return mesh;
 }
 
-GLsizei meshGenIdx(const MeshData * data, GLuint ** idxP)
+int meshGenIdx(const MeshData * data, unsigned int ** idxP)
 {
     int w = data->w;
     int h = data->h;
 
-    GLuint * idx =
-        (GLuint *) malloc(6 * (w - 1) * (h - 1) * sizeof(GLuint));
+    unsigned int * idx =
+        (unsigned int *) malloc(6 * (w - 1) * (h - 1) * sizeof(unsigned int));
 
     int x, y;
-    GLsizei base = 0;
+    int base = 0;
 
     for (y = 0; y < h - 1; ++y)
     {
@@ -6,17 +6,17 @@ struct MeshData
 {
     int w;
     int h;
-    GLfloat firstX;
-    GLfloat lastX;
-    GLfloat firstY;
-    GLfloat lastY;
-    GLfloat z;
+    float firstX;
+    float lastX;
+    float firstY;
+    float lastY;
+    float z;
 }
 MeshData;
 
 /* w, h - count of vertices in horizontal/vertical line. */
-GLfloat * meshGenVertices(const MeshData * data);
+float * meshGenVertices(const MeshData * data);
 
-GLsizei meshGenIdx(const MeshData * data, GLuint ** idxP);
+int meshGenIdx(const MeshData * data, unsigned int ** idxP);
 
 #endif /* MESH_H_SENTRY */
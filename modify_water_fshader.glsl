@@ -3,60 +3,48 @@
 uniform sampler2D texFst;
 uniform sampler2D texSnd;
 
-uniform vec2 meshTexStep;
 uniform vec2 meshViewFirst;
 uniform vec2 meshViewSize;
 
-uniform bool makeWave;
-uniform float meshZ;
+// Texel is (height, velocity), texFst is not used.
+uniform bool packedVelocity;
 
-uniform struct Transform
-{
-    mat4 rot;
-    vec3 viewPosition;
-}
-transform;
+// Impulses of this step: (x, y, radius, height) in world coordinates.
+uniform samplerBuffer texImpulses;
+uniform int impulseCnt;
+
+// Write gradients of texSnd heights for calcNormal() of draw shaders.
+uniform bool normalMap;
 
-in vec2 vpos;
 layout(location = 0) out vec4 outFragData;
+layout(location = 1) out vec4 outNormalData;
 
 const float pi = 3.14159265358979323846;
 
-// Is point p in rectangle with left-bottom corner x and
-// right-up corner y?
-bool inRect(vec2 p, vec2 x, vec2 y)
-{
-    return (all(greaterThanEqual(p, x)) && all(lessThanEqual(p, y)));
-}
-
-// Point of intersect vector "ray" emitted from position "pos" and
-// plane with x, y, or z == value (at idx == 0, 1 or 2).
-vec3 intersect(vec3 pos, vec3 ray, int idx, float value)
-{
-    float k = (value - pos[idx]) / ray[idx];
-    return pos + ray * k;
-}
-
-float calcZ(vec2 xy)
-{
-    vec2 tc = (xy - meshViewFirst) / meshViewSize;
-    float z = texture(texSnd, tc).r;
-
-    return z;
-}
-
 void main(void)
 {
-    float texX = (vpos.x*10 - meshViewFirst.x) / meshViewSize.x;
-    float texY = (vpos.y*10 - meshViewFirst.y) / meshViewSize.y;
+    // One fragment for each texel of simulation grid.
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    ivec2 texelMax = textureSize(texSnd, 0) - ivec2(1);
+    vec2 texCoord = gl_FragCoord.xy / vec2(texelMax + ivec2(1));
 
-    float zFst = texture(texFst, vec2(texX, texY)).r;
-//    float zSnd = texture(texSnd, vec2(texX, texY)).r;
+    vec4 snd = texelFetch(texSnd, texel, 0);
+    float zFst;
 
-    float zSndL = texture(texSnd, vec2(texX - meshTexStep.x, texY)).r;
-    float zSndR = texture(texSnd, vec2(texX + meshTexStep.x, texY)).r;
-    float zSndD = texture(texSnd, vec2(texX, texY - meshTexStep.y)).r;
-    float zSndU = texture(texSnd, vec2(texX, texY + meshTexStep.y)).r;
+    if (packedVelocity)
+    {
+        zFst = snd.r - snd.g;
+    }
+    else
+    {
+        zFst = texelFetch(texFst, texel, 0).r;
+    }
+
+    // Neighbours clamped to edge (as GL_CLAMP_TO_EDGE).
+    float zSndL = texelFetch(texSnd, ivec2(max(texel.x - 1, 0), texel.y), 0).r;
+    float zSndR = texelFetch(texSnd, ivec2(min(texel.x + 1, texelMax.x), texel.y), 0).r;
+    float zSndD = texelFetch(texSnd, ivec2(texel.x, max(texel.y - 1, 0)), 0).r;
+    float zSndU = texelFetch(texSnd, ivec2(texel.x, min(texel.y + 1, texelMax.y)), 0).r;
 
     const float w = 1.950;
 
@@ -64,37 +52,35 @@ void main(void)
         w * (zSndL + zSndR + zSndD + zSndU) / 4.0;
 
     // TODO: Maybe we need modify height map first and make wave after?
-    if (makeWave)
-    {
-        float wUnder = sign(transform.viewPosition.z -
-            calcZ(transform.viewPosition.xy));
+    vec2 xy = meshViewFirst + texCoord * meshViewSize;
 
-        vec3 viewRay = vec3(transform.rot * vec4(0.0, 0.0, 1.0, 1.0));
-        vec3 p = intersect(transform.viewPosition, viewRay, 2, meshZ);
+    // volume of water cast down and cast up
+    // equaled by substrict "c";
+    const float c = 0.3600349828087051;
 
-        if (sign(transform.viewPosition.z - meshZ) == sign(viewRay.z) &&
-            inRect(p.xy, vec2(-10.0, -10.0), vec2(10.0, 10.0)))
-        {
-            vec2 texCoord = (p.xy - meshViewFirst) / meshViewSize;
-            float dist = distance(vec2(texX, texY), texCoord);
+    for (int i = 0; i < impulseCnt; ++i)
+    {
+        // Height is full height from down to up wave.
+        vec4 impulse = texelFetch(texImpulses, i);
+        float dist = distance(xy, impulse.xy);
 
-            // Radius of wave.
-            float r = 2 * (meshTexStep.x + meshTexStep.y);
+        if (dist <= impulse.z)
+        {
+            dist = dist / impulse.z * (pi / 2);
+            zDst -= impulse.w * (cos(dist) - c);
+        }
+    }
 
-            // Full height from dow to up wave.
-            float h = 0.4 * wUnder;
+    outFragData = vec4(zDst, zDst - snd.r, 0.0, 0.0);
 
-            // volume of water cast down and cast up
-            // equaled by substrict "c";
-            const float c = 0.3600349828087051;
+    if (normalMap)
+    {
+        float zSndLL = texelFetch(texSnd, ivec2(max(texel.x - 3, 0), texel.y), 0).r;
+        float zSndRR = texelFetch(texSnd, ivec2(min(texel.x + 3, texelMax.x), texel.y), 0).r;
+        float zSndDD = texelFetch(texSnd, ivec2(texel.x, max(texel.y - 3, 0)), 0).r;
+        float zSndUU = texelFetch(texSnd, ivec2(texel.x, min(texel.y + 3, texelMax.y)), 0).r;
 
-            if (dist <= r)
-            {
-                dist = dist / r * (pi / 2);
-                zDst -= h * (cos(dist) - c);
-            }
-        }
+        outNormalData = vec4(pow(zSndR - zSndL, 2) + (zSndRR - zSndLL),
+            pow(zSndU - zSndD, 2) + (zSndUU - zSndDD), 0.0, 0.0);
     }
-
-    outFragData = vec4(zDst, 0.0, 0.0, 0.0);
 }
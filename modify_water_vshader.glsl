@@ -1,10 +1,35 @@
 #version 330 core
 
-in vec3 position;
-out vec2 vpos;
+uniform bool tiled;
+uniform int tileSize;
+uniform vec2 simSize;
+
+// Tile of simulation grid (in tiles), one for each instance.
+in ivec2 tile;
+
+const vec2 quad[6] = vec2[6]
+(
+    vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(0.0, 1.0),
+    vec2(1.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0)
+);
 
 void main(void)
 {
-    vpos = position.xy;
-    gl_Position = vec4(position.xy, 1.0, 1.0);
+    vec2 p;
+
+    if (tiled)
+    {
+        // Quad over the tile.
+        p = (vec2(tile) + quad[gl_VertexID]) * float(tileSize) /
+            simSize * 2.0 - 1.0;
+    }
+    else
+    {
+        // Fullscreen triangle without vertex attributes: vertices
+        // (-1, -1), (3, -1), (-1, 3), the viewport is inside it.
+        p = vec2(float((gl_VertexID & 1) << 2) - 1.0,
+            float((gl_VertexID & 2) << 1) - 1.0);
+    }
+
+    gl_Position = vec4(p, 1.0, 1.0);
 }
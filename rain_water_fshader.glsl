@@ -0,0 +1,32 @@
+#version 330 core
+
+// Full height from down to up wave of one drop.
+uniform float dropHeight;
+
+in vec2 dropCoord;
+
+// Added to destination texel by blending, velocity is changed by
+// the same value. Normal map is not changed.
+layout(location = 0) out vec4 outFragData;
+layout(location = 1) out vec4 outNormalData;
+
+const float pi = 3.14159265358979323846;
+
+void main(void)
+{
+    float dist = length(dropCoord);
+
+    // volume of water cast down and cast up
+    // equaled by substrict "c";
+    const float c = 0.3600349828087051;
+
+    if (dist > 1.0)
+    {
+        discard;
+    }
+
+    float dz = -dropHeight * (cos(dist * (pi / 2)) - c);
+
+    outFragData = vec4(dz, dz, 0.0, 0.0);
+    outNormalData = vec4(0.0);
+}
@@ -0,0 +1,44 @@
+#version 330 core
+
+uniform vec2 meshViewFirst;
+uniform vec2 meshViewSize;
+
+// Drops differ for each seed and step.
+uniform uint seed;
+uniform uint step;
+
+// In world coordinates.
+uniform float dropRadius;
+
+// Position inside the drop, (0, 0) -- center, length 1 -- edge.
+out vec2 dropCoord;
+
+const vec2 quad[6] = vec2[6]
+(
+    vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0),
+    vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0)
+);
+
+uint hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+
+    return x;
+}
+
+void main(void)
+{
+    // One drop for each instance, center in texture coordinates.
+    uint h = hash(hash(seed ^ hash(step)) + uint(gl_InstanceID));
+    vec2 center = vec2(h & 0xffffU, h >> 16) / 65535.0;
+    vec2 radius = dropRadius / meshViewSize;
+
+    dropCoord = quad[gl_VertexID];
+
+    gl_Position = vec4((center + dropCoord * radius) * 2.0 - 1.0,
+        1.0, 1.0);
+}
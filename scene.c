@@ -122,8 +122,8 @@ void setupOpenGLState(ContextSize * context, GLboolean vsync)
     /* I use small znear value instead, that work better. */
     /* glEnable(GL_DEPTH_CLAMP); */
 
-    /* For correct bilinear interpolation at rib of skybox. */
-    /* TODO: glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);*/
+    /* For correct bilinear interpolation at rib of cube map. */
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
 #if 0
     glEnable(GL_POINT_SMOOTH);
@@ -155,8 +155,14 @@ Scene * newScene(GLboolean vsync)
     scene->camera = newCamera(scene->context->w, scene->context->h);
 
     scene->world = getWorld("world.txt");
+    scene->proxy = newWorldProxy(scene->world);
     scene->water = getWater();
     setupWater(scene->water->drawSP, scene->world);
+    setupWorldProxy(scene->water->drawSP, scene->proxy);
+    scene->env = newWaterEnv(scene->world, scene->water);
+    setupWaterEnv(scene->water->drawSP, scene->env);
+    scene->mirror = newWaterMirror(scene->world);
+    setupWaterMirror(scene->water->drawSP, scene->mirror);
     setupWorldUniforms(scene->world->sp, scene->water);
 
     return scene;
@@ -165,6 +171,9 @@ Scene * newScene(GLboolean vsync)
 void freeScene(Scene * scene)
 {
     freeCamera(scene->camera);
+    freeWorldProxy(scene->proxy);
+    freeWaterEnv(scene->env);
+    freeWaterMirror(scene->mirror);
     freeWorld(scene->world);
     freeWater(scene->water);
     free(scene->context);
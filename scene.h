@@ -3,7 +3,10 @@
 
 #include "camera.h"
 #include "world.h"
+#include "world_proxy.h"
 #include "water.h"
+#include "water_env.h"
+#include "water_mirror.h"
 
 typedef
 struct ContextSize
@@ -21,7 +24,10 @@ struct Scene
     Camera * camera;
 
     World * world;
+    WorldProxy * proxy;
     Water * water;
+    WaterEnv * env;
+    WaterMirror * mirror;
 }
 Scene;
 
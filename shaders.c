@@ -84,7 +84,7 @@ void freeShaderProgram(ShaderProgram * sp)
     glDeleteProgram(sp->p);
 }
 
-void setupVbo(ShaderProgram * sp, const GLfloat * data,
+GLuint setupVbo(ShaderProgram * sp, const GLfloat * data,
     const char * attrName, int groupSize, GLsizei cnt)
 {
     GLuint vboP, attribP;
@@ -103,9 +103,11 @@ void setupVbo(ShaderProgram * sp, const GLfloat * data,
     glEnableVertexAttribArray(attribP);
 
     CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+
+    return vboP;
 }
 
-void setupIdxVbo(ShaderProgram * sp, const GLuint * idx, GLsizei cnt)
+GLuint setupIdxVbo(ShaderProgram * sp, const GLuint * idx, GLsizei cnt)
 {
     GLuint vboIdxP;
 
@@ -117,4 +119,62 @@ void setupIdxVbo(ShaderProgram * sp, const GLuint * idx, GLsizei cnt)
         idx, GL_STATIC_DRAW);
 
     CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+
+    return vboIdxP;
+}
+
+void setupUniformBlock(ShaderProgram * sp, const char * blockName,
+    GLuint binding)
+{
+    GLuint idx = glGetUniformBlockIndex(sp->p, blockName);
+
+    if (idx != GL_INVALID_INDEX)
+    {
+        glUniformBlockBinding(sp->p, idx, binding);
+    }
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+}
+
+UniformBuffer * newUniformBuffer(GLsizeiptr size, int slotCnt)
+{
+    UniformBuffer * ub = (UniformBuffer *) malloc(sizeof(UniformBuffer));
+    GLint align;
+
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+
+    ub->size = size;
+    ub->stride = (size + align - 1) / align * align;
+    ub->slotCnt = slotCnt;
+
+    glGenBuffers(1, &(ub->id));
+    glBindBuffer(GL_UNIFORM_BUFFER, ub->id);
+    glBufferData(GL_UNIFORM_BUFFER, ub->stride * slotCnt, NULL,
+        GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+
+    return ub;
+}
+
+void setUniformBufferSlot(UniformBuffer * ub, int slot, const GLvoid * data)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, ub->id);
+    glBufferSubData(GL_UNIFORM_BUFFER, ub->stride * slot, ub->size, data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void bindUniformBufferSlot(const UniformBuffer * ub, GLuint binding,
+    int slot)
+{
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, ub->id,
+        ub->stride * slot, ub->size);
+}
+
+void freeUniformBuffer(UniformBuffer * ub)
+{
+    glDeleteBuffers(1, &(ub->id));
+
+    free(ub);
 }
@@ -13,14 +13,51 @@ struct ShaderProgram
 }
 ShaderProgram;
 
+/* Binding points of std140 uniform blocks shared by draw programs. Water
+ * has its own binding of Material block, so drawWorld() can rebind world
+ * material without touching water. */
+#define UNIFORM_BINDING_TRANSFORM 0
+#define UNIFORM_BINDING_POINT_LIGHT 1
+#define UNIFORM_BINDING_MATERIAL 2
+#define UNIFORM_BINDING_WATER_MATERIAL 3
+
+/* Uniform buffer of slotCnt blocks, each of them is bound by range. */
+typedef
+struct UniformBuffer
+{
+    GLuint id;
+
+    /* Size of block and distance between slots (block size aligned to
+     * GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT). */
+    GLsizeiptr size;
+    GLsizeiptr stride;
+    int slotCnt;
+}
+UniformBuffer;
+
 ShaderProgram * getShaderProgram(const char * vPath,
     const char * gPath, const char * fPath);
 
 void freeShaderProgram(ShaderProgram * sp);
 
-void setupVbo(ShaderProgram * sp, const GLfloat * data,
+/* Both return buffer, it is attached to current vertex array. */
+GLuint setupVbo(ShaderProgram * sp, const GLfloat * data,
     const char * attrName, int groupSize, GLsizei cnt);
 
-void setupIdxVbo(ShaderProgram * sp, const GLuint * idx, GLsizei cnt);
+GLuint setupIdxVbo(ShaderProgram * sp, const GLuint * idx, GLsizei cnt);
+
+/* Binds uniform block of sp to binding, if sp has such block. */
+void setupUniformBlock(ShaderProgram * sp, const char * blockName,
+    GLuint binding);
+
+UniformBuffer * newUniformBuffer(GLsizeiptr size, int slotCnt);
+
+/* Writes size bytes of data to slot. */
+void setUniformBufferSlot(UniformBuffer * ub, int slot, const GLvoid * data);
+
+void bindUniformBufferSlot(const UniformBuffer * ub, GLuint binding,
+    int slot);
+
+void freeUniformBuffer(UniformBuffer * ub);
 
 #endif /* SHADERS_H_SENTRY */
@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <string.h>
+#include "string_table.h"
+
+#define STRING_TABLE_CAPACITY_MIN 64
+#define NAME_INDEX_CAPACITY_MIN 16
+
+/* FNV-1a. */
+unsigned int hashString(const char * str, int length)
+{
+    unsigned int hash = 2166136261U;
+    int i;
+
+    for (i = 0; i < length; ++i)
+    {
+        hash ^= (unsigned char) str[i];
+        hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+/* ---- String table ---- */
+
+static void allocStringTable(StringTable * table, int capacity)
+{
+    table->entries = (StringTableEntry *)
+        calloc(capacity, sizeof(StringTableEntry));
+    table->capacity = capacity;
+    table->cnt = 0;
+}
+
+static void growStringTable(StringTable * table)
+{
+    StringTableEntry * old = table->entries;
+    int oldCapacity = table->capacity;
+    int i;
+
+    allocStringTable(table, oldCapacity * 2);
+
+    for (i = 0; i < oldCapacity; ++i)
+    {
+        if (old[i].str != NULL)
+        {
+            int mask = table->capacity - 1;
+            int pos = old[i].hash & mask;
+
+            while (table->entries[pos].str != NULL)
+            {
+                pos = (pos + 1) & mask;
+            }
+
+            table->entries[pos] = old[i];
+            ++(table->cnt);
+        }
+    }
+
+    free(old);
+}
+
+StringTable * newStringTable(void)
+{
+    StringTable * table = (StringTable *) malloc(sizeof(StringTable));
+
+    allocStringTable(table, STRING_TABLE_CAPACITY_MIN);
+
+    return table;
+}
+
+const char * internString(StringTable * table, const char * str,
+    int length)
+{
+    unsigned int hash = hashString(str, length);
+    int mask = table->capacity - 1;
+    int pos = hash & mask;
+    StringTableEntry * entry;
+
+    for (entry = table->entries + pos; entry->str != NULL;
+        entry = table->entries + pos)
+    {
+        if (entry->hash == hash &&
+            strncmp(entry->str, str, length) == 0 &&
+            entry->str[length] == '\0')
+        {
+            return entry->str;
+        }
+
+        pos = (pos + 1) & mask;
+    }
+
+    entry->str = (char *) malloc(length + 1);
+    memcpy(entry->str, str, length);
+    entry->str[length] = '\0';
+    entry->hash = hash;
+    str = entry->str;
+
+    if (2 * ++(table->cnt) > table->capacity)
+    {
+        growStringTable(table);
+    }
+
+    return str;
+}
+
+void freeStringTable(StringTable * table)
+{
+    int i;
+
+    for (i = 0; i < table->capacity; ++i)
+    {
+        free(table->entries[i].str);
+    }
+
+    free(table->entries);
+    free(table);
+}
+
+/* ---- Name index ---- */
+
+static void allocNameIndex(NameIndex * index, int capacity)
+{
+    index->entries = (NameIndexEntry *)
+        calloc(capacity, sizeof(NameIndexEntry));
+    index->capacity = capacity;
+    index->cnt = 0;
+}
+
+/* Slot of name or empty slot, where it would be. */
+static NameIndexEntry * findNameIndexEntry(const NameIndex * index,
+    const char * name, unsigned int hash)
+{
+    int mask = index->capacity - 1;
+    int pos = hash & mask;
+    NameIndexEntry * entry;
+
+    for (entry = index->entries + pos; entry->name != NULL;
+        entry = index->entries + pos)
+    {
+        /* Interned names are equal by pointer. */
+        if (entry->hash == hash &&
+            (entry->name == name || strcmp(entry->name, name) == 0))
+        {
+            return entry;
+        }
+
+        pos = (pos + 1) & mask;
+    }
+
+    return entry;
+}
+
+static void growNameIndex(NameIndex * index)
+{
+    NameIndexEntry * old = index->entries;
+    int oldCapacity = index->capacity;
+    int i;
+
+    allocNameIndex(index, oldCapacity * 2);
+
+    for (i = 0; i < oldCapacity; ++i)
+    {
+        if (old[i].name != NULL)
+        {
+            *findNameIndexEntry(index, old[i].name, old[i].hash) = old[i];
+            ++(index->cnt);
+        }
+    }
+
+    free(old);
+}
+
+void initNameIndex(NameIndex * index)
+{
+    /* Allocated by first addition. */
+    index->entries = NULL;
+    index->capacity = 0;
+    index->cnt = 0;
+}
+
+void * addToNameIndex(NameIndex * index, const char * name, void * value)
+{
+    unsigned int hash = hashString(name, strlen(name));
+    NameIndexEntry * entry;
+
+    if (index->entries == NULL)
+    {
+        allocNameIndex(index, NAME_INDEX_CAPACITY_MIN);
+    }
+
+    entry = findNameIndexEntry(index, name, hash);
+
+    if (entry->name != NULL)
+    {
+        return entry->value;
+    }
+
+    entry->name = name;
+    entry->hash = hash;
+    entry->value = value;
+
+    if (2 * ++(index->cnt) > index->capacity)
+    {
+        growNameIndex(index);
+    }
+
+    return NULL;
+}
+
+void * getFromNameIndex(const NameIndex * index, const char * name)
+{
+    if (index->entries == NULL)
+    {
+        return NULL;
+    }
+
+    return findNameIndexEntry(index, name,
+        hashString(name, strlen(name)))->value;
+}
+
+void freeNameIndex(NameIndex * index)
+{
+    free(index->entries);
+    initNameIndex(index);
+}
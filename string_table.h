@@ -0,0 +1,68 @@
+#ifndef STRING_TABLE_H_SENTRY
+#define STRING_TABLE_H_SENTRY
+
+/* Hash tables with open addressing (linear probing), capacity is power
+ * of two and at most half of slots are used. */
+
+typedef
+struct StringTableEntry
+{
+    char * str;
+    unsigned int hash;
+}
+StringTableEntry;
+
+/* Interned strings: each string is stored once, so equal strings are
+ * the same pointer. */
+typedef
+struct StringTable
+{
+    StringTableEntry * entries;
+    int capacity;
+    int cnt;
+}
+StringTable;
+
+typedef
+struct NameIndexEntry
+{
+    const char * name;
+    unsigned int hash;
+    void * value;
+}
+NameIndexEntry;
+
+/* Name to object map, names are not copied. */
+typedef
+struct NameIndex
+{
+    NameIndexEntry * entries;
+    int capacity;
+    int cnt;
+}
+NameIndex;
+
+unsigned int hashString(const char * str, int length);
+
+StringTable * newStringTable(void);
+
+/* Returns stored null-terminated copy of str (length characters, str
+ * can be not null-terminated). */
+const char * internString(StringTable * table, const char * str,
+    int length);
+
+/* Frees all interned strings too. */
+void freeStringTable(StringTable * table);
+
+void initNameIndex(NameIndex * index);
+
+/* Returns value of name, if it is already in index (value is not
+ * stored then); NULL otherwise. value must not be NULL. */
+void * addToNameIndex(NameIndex * index, const char * name, void * value);
+
+/* NULL if not found. */
+void * getFromNameIndex(const NameIndex * index, const char * name);
+
+void freeNameIndex(NameIndex * index);
+
+#endif /* STRING_TABLE_H_SENTRY */
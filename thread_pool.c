@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "thread_pool.h"
+
+int getProcessorsCount()
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long cnt = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cnt > 0)
+    {
+        return (int) cnt;
+    }
+#endif
+
+    return 1;
+}
+
+/* Returns task index or -1, if queue is empty. */
+static int takeOwnTask(ThreadPoolQueue * queue)
+{
+    int taskIdx = -1;
+
+    pthread_mutex_lock(&(queue->mutex));
+
+    if (queue->first < queue->last)
+    {
+        taskIdx = queue->first;
+        ++(queue->first);
+    }
+
+    pthread_mutex_unlock(&(queue->mutex));
+
+    return taskIdx;
+}
+
+/* Moves half of tasks from end of some other queue to own queue.
+ * Returns first of them or -1, if all queues are empty. */
+static int stealTasks(ThreadPool * pool, int self)
+{
+    int i;
+
+    for (i = 1; i < pool->threadCnt; ++i)
+    {
+        ThreadPoolQueue * victim =
+            &(pool->queues[(self + i) % pool->threadCnt]);
+        ThreadPoolQueue * own = &(pool->queues[self]);
+        int first, last;
+
+        pthread_mutex_lock(&(victim->mutex));
+
+        last = victim->last;
+        first = last - (last - victim->first + 1) / 2;
+        victim->last = first;
+
+        pthread_mutex_unlock(&(victim->mutex));
+
+        if (first < last)
+        {
+            pthread_mutex_lock(&(own->mutex));
+            own->first = first + 1;
+            own->last = last;
+            pthread_mutex_unlock(&(own->mutex));
+
+            return first;
+        }
+    }
+
+    return -1;
+}
+
+static void workTasks(ThreadPool * pool, int self)
+{
+    int taskIdx;
+
+    while ((taskIdx = takeOwnTask(&(pool->queues[self]))) >= 0 ||
+        (taskIdx = stealTasks(pool, self)) >= 0)
+    {
+        pool->func(pool->arg, taskIdx);
+    }
+}
+
+static void * threadPoolMain(void * arg)
+{
+    ThreadPoolQueue * queue = (ThreadPoolQueue *) arg;
+    ThreadPool * pool = queue->pool;
+    int self = queue - pool->queues;
+    int generation = 0;
+
+    pthread_mutex_lock(&(pool->mutex));
+
+    do
+    {
+        while (pool->running && pool->generation == generation)
+        {
+            pthread_cond_wait(&(pool->startCond), &(pool->mutex));
+        }
+
+        if (! pool->running)
+        {
+            break;
+        }
+
+        generation = pool->generation;
+        pthread_mutex_unlock(&(pool->mutex));
+
+        workTasks(pool, self);
+
+        pthread_mutex_lock(&(pool->mutex));
+        ++(pool->finishedCnt);
+
+        if (pool->finishedCnt == pool->threadCnt - 1)
+        {
+            pthread_cond_signal(&(pool->doneCond));
+        }
+    }
+    while (1);
+
+    pthread_mutex_unlock(&(pool->mutex));
+
+    return NULL;
+}
+
+ThreadPool * newThreadPool(int threadCnt)
+{
+    ThreadPool * pool = (ThreadPool *) malloc(sizeof(ThreadPool));
+    int i;
+
+    pool->threadCnt = (threadCnt > 0) ? threadCnt : getProcessorsCount();
+    pool->threads = (pthread_t *) malloc(pool->threadCnt * sizeof(pthread_t));
+    pool->queues = (ThreadPoolQueue *)
+        malloc(pool->threadCnt * sizeof(ThreadPoolQueue));
+
+    pthread_mutex_init(&(pool->mutex), NULL);
+    pthread_cond_init(&(pool->startCond), NULL);
+    pthread_cond_init(&(pool->doneCond), NULL);
+
+    pool->func = NULL;
+    pool->arg = NULL;
+    pool->generation = 0;
+    pool->finishedCnt = 0;
+    pool->running = 1;
+
+    for (i = 0; i < pool->threadCnt; ++i)
+    {
+        pthread_mutex_init(&(pool->queues[i].mutex), NULL);
+        pool->queues[i].pool = pool;
+        pool->queues[i].first = 0;
+        pool->queues[i].last = 0;
+    }
+
+    /* Worker 0 is the thread which calls runThreadPool(). */
+    for (i = 1; i < pool->threadCnt; ++i)
+    {
+        if (pthread_create(&(pool->threads[i]), NULL, threadPoolMain,
+            &(pool->queues[i])) != 0)
+        {
+            fprintf(stderr, "newThreadPool() failed: pthread_create.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return pool;
+}
+
+void runThreadPool(ThreadPool * pool, ThreadPoolFunc func, void * arg,
+    int taskCnt)
+{
+    int i;
+
+    if (pool->threadCnt == 1 || taskCnt <= 1)
+    {
+        for (i = 0; i < taskCnt; ++i)
+        {
+            func(arg, i);
+        }
+
+        return;
+    }
+
+    pthread_mutex_lock(&(pool->mutex));
+
+    /* Neighbour tasks to the same worker, while nothing is stolen. */
+    for (i = 0; i < pool->threadCnt; ++i)
+    {
+        pthread_mutex_lock(&(pool->queues[i].mutex));
+        pool->queues[i].first = taskCnt * i / pool->threadCnt;
+        pool->queues[i].last = taskCnt * (i + 1) / pool->threadCnt;
+        pthread_mutex_unlock(&(pool->queues[i].mutex));
+    }
+
+    pool->func = func;
+    pool->arg = arg;
+    pool->finishedCnt = 0;
+    ++(pool->generation);
+
+    pthread_cond_broadcast(&(pool->startCond));
+    pthread_mutex_unlock(&(pool->mutex));
+
+    workTasks(pool, 0);
+
+    pthread_mutex_lock(&(pool->mutex));
+
+    while (pool->finishedCnt < pool->threadCnt - 1)
+    {
+        pthread_cond_wait(&(pool->doneCond), &(pool->mutex));
+    }
+
+    pthread_mutex_unlock(&(pool->mutex));
+}
+
+void freeThreadPool(ThreadPool * pool)
+{
+    int i;
+
+    pthread_mutex_lock(&(pool->mutex));
+    pool->running = 0;
+    pthread_cond_broadcast(&(pool->startCond));
+    pthread_mutex_unlock(&(pool->mutex));
+
+    for (i = 1; i < pool->threadCnt; ++i)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    for (i = 0; i < pool->threadCnt; ++i)
+    {
+        pthread_mutex_destroy(&(pool->queues[i].mutex));
+    }
+
+    pthread_cond_destroy(&(pool->doneCond));
+    pthread_cond_destroy(&(pool->startCond));
+    pthread_mutex_destroy(&(pool->mutex));
+
+    free(pool->queues);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H_SENTRY
+#define THREAD_POOL_H_SENTRY
+
+#include <pthread.h>
+
+/* Called once for each taskIdx in [0; taskCnt). */
+typedef void (*ThreadPoolFunc)(void * arg, int taskIdx);
+
+/* Tasks of one worker: [first; last), owner takes from begin,
+ * other workers steal from end. */
+typedef
+struct ThreadPoolQueue
+{
+    struct ThreadPool * pool;
+
+    pthread_mutex_t mutex;
+    int first;
+    int last;
+}
+ThreadPoolQueue;
+
+typedef
+struct ThreadPool
+{
+    /* Count of workers, including the thread which calls
+     * runThreadPool(). */
+    int threadCnt;
+
+    pthread_t * threads;
+    ThreadPoolQueue * queues;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t startCond;
+    pthread_cond_t doneCond;
+
+    /* Current run, protected by mutex. */
+    ThreadPoolFunc func;
+    void * arg;
+    int generation;
+    int finishedCnt;
+    int running;
+}
+ThreadPool;
+
+/* Count of online processors, 1 if unknown. */
+int getProcessorsCount();
+
+/* threadCnt <= 0 -- one worker for each processor. */
+ThreadPool * newThreadPool(int threadCnt);
+
+/* Returns when all tasks are done. */
+void runThreadPool(ThreadPool * pool, ThreadPoolFunc func, void * arg,
+    int taskCnt);
+
+void freeThreadPool(ThreadPool * pool);
+
+#endif /* THREAD_POOL_H_SENTRY */
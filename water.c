@@ -1,10 +1,78 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include "water.h"
 #include "texture.h"
 #include "shaders_errors.h"
 
+#define WATER_STEP_SECONDS 0.05f
+
+#define WATER_SIM_SIZE_DEFAULT 64
+#define WATER_MESH_SIZE_DEFAULT 64
+
+/* Sparse simulation: tile is WATER_TILE_SIZE x WATER_TILE_SIZE texels,
+ * it sleeps when its activity (see measure_water_fshader.glsl) and
+ * activity of its neighbours are below activityMin of format. */
+#define WATER_TILE_SIZE 16
+
+/* In world coordinates, 2 texels of 64x64 grid. */
+#define WATER_WAVE_RADIUS 1.27f
+#define WATER_WAVE_HEIGHT 0.4f
+
+#define WATER_RAIN_DROP_HEIGHT 0.05f
+
+/* Each texel checks all impulses of step, so rain of hundreds of drops
+ * costs one pass. */
+#define WATER_IMPULSES_PER_STEP 1024
+
+/* Heights textures are bound to units WATER_HEIGHTS_UNIT + i for all
+ * time, heights after last step also to WATER_GEOMETRY_UNIT for draw.
+ * Normal map is bound to WATER_NORMALS_UNIT, reduced shading buffer to
+ * WATER_SHADE_*_UNIT. */
+#define WATER_SHADE_COLOR_UNIT 2
+#define WATER_SHADE_GUIDE_UNIT 3
+#define WATER_GEOMETRY_UNIT 4
+#define WATER_NORMALS_UNIT 5
+#define WATER_HEIGHTS_UNIT 6
+#define WATER_IMPULSES_UNIT 9
+
+typedef
+struct WaterFormatInfo
+{
+    const char * name;
+    GLint internalFormat;
+    int texelBytes;
+    /* Height and velocity in one texel, two textures instead of three. */
+    GLboolean packed;
+    /* Rounding of half floats keeps oscillations about 1e-4 forever. */
+    GLfloat activityMin;
+}
+WaterFormatInfo;
+
+/* Indexed by WaterFormat. */
+static const WaterFormatInfo formatInfo[] =
+{
+    {"RGBA32F", GL_RGBA32F, 16, GL_FALSE, 1e-5f},
+    {"R32F", GL_R32F, 4, GL_FALSE, 1e-5f},
+    {"R16F", GL_R16F, 2, GL_FALSE, 5e-4f},
+    {"RG32F", GL_RG32F, 8, GL_TRUE, 1e-5f},
+    {"RG16F", GL_RG16F, 4, GL_TRUE, 5e-4f}
+};
+
+/* Textures of step with firstTexture == s. Three textures: fst == s,
+ * snd == s + 1, dst == s + 2; two (packed) textures: snd == s,
+ * dst == s + 1. */
+static int getSndTexture(const Water * water, int s)
+{
+    return (s + water->textureCnt - 2) % water->textureCnt;
+}
+
+static int getDstTexture(const Water * water, int s)
+{
+    return (s + water->textureCnt - 1) % water->textureCnt;
+}
+
 void checkFramebufferStatus()
 {
     GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
@@ -20,22 +88,27 @@ void initWaterMeshData(Water * water)
 {
     water->data = (MeshData *) malloc(sizeof(MeshData));
 
-    water->data->w = 64;
-    water->data->h = 64;
+    water->data->w = WATER_MESH_SIZE_DEFAULT;
+    water->data->h = WATER_MESH_SIZE_DEFAULT;
     water->data->firstX = -10.0f;
     water->data->lastX = 10.0f;
     water->data->firstY = -10.0f;
     water->data->lastY = 10.0f;
     water->data->z = 0.50f;
+
+    water->simW = WATER_SIM_SIZE_DEFAULT;
+    water->simH = WATER_SIM_SIZE_DEFAULT;
+    water->format = WATER_FORMAT_R32F;
+    water->normalMap = GL_TRUE;
 }
 
 void genTextures(Water * water)
 {
-    int w = water->data->w;
-    int h = water->data->h;
-    GLfloat z = water->data->z;
+    int w = water->simW;
+    int h = water->simH;
+    GLint internalFormat = formatInfo[water->format].internalFormat;
 
-    int x, y;
+    int x, y, i;
 
     GLfloat * data = (GLfloat *) malloc(w * h * 4 * sizeof(GLfloat));
 
@@ -45,7 +118,8 @@ void genTextures(Water * water)
     {
         for (x = 0; x < w; ++x)
         {
-            data[base + 0] = z;
+            /* Relative to data->z. */
+            data[base + 0] = 0.0f;
             data[base + 1] = 0.0f;
             data[base + 2] = 0.0f;
             data[base + 3] = 0.0f;
@@ -54,90 +128,356 @@ void genTextures(Water * water)
         }
     }
 
+    water->textureCnt = formatInfo[water->format].packed ? 2 : 3;
     water->textureIds = (GLuint *) malloc(3 * sizeof(GLuint));
 
-    water->textureIds[0] = createTexture(w, h, GL_RGBA32F, data);
-    water->textureIds[1] = createTexture(w, h, GL_RGBA32F, data);
-    water->textureIds[2] = createTexture(w, h, GL_RGBA32F, data);
+    for (i = 0; i < water->textureCnt; ++i)
+    {
+        water->textureIds[i] = createTexture(w, h, internalFormat, data);
+    }
+
+    /* Zero gradients -- flat water. */
+    water->normalTextureId = createTexture(w, h, GL_RG16F, data);
+    water->normalsStale = GL_TRUE;
 
     free(data);
 }
 
-void rotateTextures(Water * water)
+/* Step writes normal map only when it is on. */
+void setupDrawBuffers(Water * water)
 {
-    int nxt[] = {1, 2, 0};
-
-    GLuint newFst = nxt[water->firstTexture];
-    GLuint newSnd = nxt[newFst];
-    GLuint newDst = nxt[newSnd];
+    const GLenum drawBuffers[] =
+        {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    int i;
 
-    water->firstTexture = newFst;
+    for (i = 0; i < water->textureCnt; ++i)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, water->fboIds[i]);
+        glDrawBuffers(water->normalMap ? 2 : 1, drawBuffers);
+    }
 
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, water->textureIds[newFst]);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
 
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, water->textureIds[newSnd]);
+void genFramebuffers(Water * water)
+{
+    int i;
 
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_2D, water->textureIds[newDst]);
+    glGenFramebuffers(water->textureCnt, water->fboIds);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, water->fboId);
+    for (i = 0; i < water->textureCnt; ++i)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, water->fboIds[i]);
 
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-        GL_TEXTURE_2D, water->textureIds[newDst], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+            GL_TEXTURE_2D, water->textureIds[getDstTexture(water, i)], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+            GL_TEXTURE_2D, water->normalTextureId, 0);
 
-#ifdef DEBUG
-    checkFramebufferStatus();
-#endif
+        checkFramebufferStatus();
+    }
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+    setupDrawBuffers(water);
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+}
+
+void bindTextures(Water * water)
+{
+    int i;
+
+    for (i = 0; i < water->textureCnt; ++i)
+    {
+        glActiveTexture(GL_TEXTURE0 + WATER_HEIGHTS_UNIT + i);
+        glBindTexture(GL_TEXTURE_2D, water->textureIds[i]);
+    }
+
+    glActiveTexture(GL_TEXTURE0 + WATER_NORMALS_UNIT);
+    glBindTexture(GL_TEXTURE_2D, water->normalTextureId);
+
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, 0);
 
     CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
 }
 
-void initModifyWaterShaderProgram(Water * water, const GLfloat * mesh,
-    const GLuint * idx)
+/* Heights after last step to unit for draw. */
+void bindLastTexture(Water * water)
+{
+    glActiveTexture(GL_TEXTURE0 + WATER_GEOMETRY_UNIT);
+    glBindTexture(GL_TEXTURE_2D,
+        water->textureIds[getDstTexture(water, water->firstTexture)]);
+
+    glActiveTexture(GL_TEXTURE0);
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+}
+
+/* "tile" attribute of current vertex array from buffer vboP. */
+void setupTileAttrib(ShaderProgram * sp, GLuint vboP, GLuint divisor)
+{
+    GLint attribP = glGetAttribLocation(sp->p, "tile");
+    /* TODO: if (attribP == -1) {} */
+
+    glBindBuffer(GL_ARRAY_BUFFER, vboP);
+    glVertexAttribIPointer(attribP, 2, GL_INT, 0, (const GLvoid *) 0);
+    glEnableVertexAttribArray(attribP);
+    glVertexAttribDivisor(attribP, divisor);
+}
+
+void initModifyWaterShaderProgram(Water * water)
 {
     water->modifySP = getShaderProgram("modify_water_vshader.glsl",
         NULL, "modify_water_fshader.glsl");
+    water->measureSP = getShaderProgram("measure_water_vshader.glsl",
+        NULL, "measure_water_fshader.glsl");
 
+    /* Active tiles, see selectTiles(). */
+    glGenBuffers(1, &(water->tiles.vboP));
+
+    /* Quad for each active tile (instance) or fullscreen triangle. */
     glGenVertexArrays(1, &(water->modifyVaoP));
     glBindVertexArray(water->modifyVaoP);
+    setupTileAttrib(water->modifySP, water->tiles.vboP, 1);
 
-    setupVbo(water->modifySP, mesh, "position", 3,
-        water->data->w * water->data->h);
-    setupIdxVbo(water->modifySP, idx, water->idxCnt);
+    /* Point for each active tile. */
+    glGenVertexArrays(1, &(water->tiles.measureVaoP));
+    glBindVertexArray(water->tiles.measureVaoP);
+    setupTileAttrib(water->measureSP, water->tiles.vboP, 0);
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+}
 
-    glGenFramebuffers(1, &(water->fboId));
+void genImpulses(Water * water)
+{
+    water->impulseCnt = 0;
+    water->impulseMax = WATER_IMPULSES_PER_STEP;
+    water->impulses =
+        (GLfloat *) malloc(water->impulseMax * 4 * sizeof(GLfloat));
+
+    glGenBuffers(1, &(water->impulseTboP));
+    glBindBuffer(GL_TEXTURE_BUFFER, water->impulseTboP);
+    glBufferData(GL_TEXTURE_BUFFER,
+        WATER_IMPULSES_PER_STEP * 4 * sizeof(GLfloat), NULL,
+        GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glGenTextures(1, &(water->impulseTextureId));
+    glActiveTexture(GL_TEXTURE0 + WATER_IMPULSES_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, water->impulseTextureId);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, water->impulseTboP);
+    glActiveTexture(GL_TEXTURE0);
 
     CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
 }
 
-void initDrawWaterShaderProgram(Water * water, const GLfloat * mesh,
-    const GLuint * idx)
+void initRainShaderProgram(Water * water)
 {
-    water->drawSP = getShaderProgram("draw_water_vshader.glsl",
-        NULL, "draw_water_fshader.glsl");
+    WaterRain * rain = &(water->rain);
+    float sizeX = water->data->lastX - water->data->firstX;
+    float sizeY = water->data->lastY - water->data->firstY;
+
+    GLuint obj;
+
+    rain->sp = getShaderProgram("rain_water_vshader.glsl",
+        NULL, "rain_water_fshader.glsl");
+
+    /* Drops have no vertex attributes. */
+    glGenVertexArrays(1, &(rain->vaoP));
+
+    glUseProgram(rain->sp->p);
+
+    obj = glGetUniformLocation(rain->sp->p, "meshViewFirst");
+    /* TODO: if (obj == -1) {} */
+    glUniform2f(obj, water->data->firstX, water->data->firstY);
+
+    obj = glGetUniformLocation(rain->sp->p, "meshViewSize");
+    /* TODO: if (obj == -1) {} */
+    glUniform2f(obj, sizeX, sizeY);
+
+    obj = glGetUniformLocation(rain->sp->p, "dropHeight");
+    /* TODO: if (obj == -1) {} */
+    glUniform1f(obj, WATER_RAIN_DROP_HEIGHT);
+
+    rain->stepLoc = glGetUniformLocation(rain->sp->p, "step");
+    /* TODO: if (rain->stepLoc == -1) {} */
+
+    rain->dropsPerSecond = 0.0f;
+    rain->dropRadius = 0.0f;
+    rain->seed = 0;
+    rain->dropSum = 0.0f;
+    rain->stepCnt = 0;
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+    glUseProgram(0);
+}
+
+/* Uploads impulses for next step and removes them from queue. Program
+ * is current. */
+void takeImpulses(Water * water)
+{
+    int cnt = (water->impulseCnt < WATER_IMPULSES_PER_STEP) ?
+        water->impulseCnt : WATER_IMPULSES_PER_STEP;
+
+    if (cnt > 0)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, water->impulseTboP);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, cnt * 4 * sizeof(GLfloat),
+            water->impulses);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        water->impulseCnt -= cnt;
+        memmove(water->impulses, water->impulses + cnt * 4,
+            water->impulseCnt * 4 * sizeof(GLfloat));
+    }
+
+    glUniform1i(water->impulseCntLoc, cnt);
+}
+
+/* marks == NULL -- all tiles are active. Otherwise tile is active if
+ * some tile in radius (in tiles) is marked, see markTiles(). */
+void selectTiles(Water * water, const unsigned char * marks, int radius)
+{
+    WaterTiles * tiles = &(water->tiles);
+    int x, y, dx, dy;
+
+    /* Already uploaded. */
+    if (marks == NULL && tiles->activeCnt == tiles->w * tiles->h)
+    {
+        return;
+    }
+
+    tiles->activeCnt = 0;
+
+    for (y = 0; y < tiles->h; ++y)
+    {
+        for (x = 0; x < tiles->w; ++x)
+        {
+            int on = 0;
+
+            for (dy = -radius; dy <= radius && !on; ++dy)
+            {
+                for (dx = -radius; dx <= radius && !on; ++dx)
+                {
+                    int tx = x + dx;
+                    int ty = y + dy;
+
+                    on = (marks == NULL || (tx >= 0 && tx < tiles->w &&
+                        ty >= 0 && ty < tiles->h &&
+                        marks[ty * tiles->w + tx]));
+                }
+            }
+
+            if (on)
+            {
+                tiles->active[2 * tiles->activeCnt + 0] = x;
+                tiles->active[2 * tiles->activeCnt + 1] = y;
+                ++(tiles->activeCnt);
+            }
+        }
+    }
+
+    if (tiles->activeCnt > 0)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, tiles->vboP);
+        glBufferData(GL_ARRAY_BUFFER,
+            2 * tiles->activeCnt * sizeof(GLint), tiles->active,
+            GL_STREAM_DRAW);
+    }
+}
+
+void genTiles(Water * water)
+{
+    WaterTiles * tiles = &(water->tiles);
+    const GLfloat zero[] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+    tiles->w = (water->simW + WATER_TILE_SIZE - 1) / WATER_TILE_SIZE;
+    tiles->h = (water->simH + WATER_TILE_SIZE - 1) / WATER_TILE_SIZE;
+
+    tiles->active =
+        (GLint *) malloc(2 * tiles->w * tiles->h * sizeof(GLint));
+    tiles->marks = (unsigned char *) malloc(tiles->w * tiles->h);
+
+    tiles->activeCnt = 0;
+    selectTiles(water, NULL, 0);
+
+    tiles->activityTextureId =
+        createTexture(tiles->w, tiles->h, GL_R32F, NULL);
+
+    glGenFramebuffers(1, &(tiles->activityFboId));
+    glBindFramebuffer(GL_FRAMEBUFFER, tiles->activityFboId);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, tiles->activityTextureId, 0);
+
+    checkFramebufferStatus();
+
+    glClearBufferfv(GL_COLOR, 0, zero);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glGenBuffers(1, &(tiles->activityPboP));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, tiles->activityPboP);
+    glBufferData(GL_PIXEL_PACK_BUFFER,
+        tiles->w * tiles->h * sizeof(GLfloat), NULL, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    tiles->activityFence = 0;
+    tiles->activityKept = GL_FALSE;
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+}
+
+void freeTiles(Water * water)
+{
+    WaterTiles * tiles = &(water->tiles);
+
+    if (tiles->activityFence != 0)
+    {
+        glDeleteSync(tiles->activityFence);
+    }
+
+    glDeleteBuffers(1, &(tiles->activityPboP));
+    glDeleteFramebuffers(1, &(tiles->activityFboId));
+    glDeleteTextures(1, &(tiles->activityTextureId));
+
+    free(tiles->marks);
+    free(tiles->active);
+}
+
+/* Buffers of render mesh with water->data->w x water->data->h
+ * vertices. */
+void setupDrawMesh(Water * water)
+{
+    GLfloat * mesh = meshGenVertices(water->data);
+    GLuint * idx;
+
+    water->idxCnt = meshGenIdx(water->data, &idx);
 
-    glGenVertexArrays(1, &(water->drawVaoP));
     glBindVertexArray(water->drawVaoP);
 
-    setupVbo(water->drawSP, mesh, "position", 3,
+    water->drawVboP = setupVbo(water->drawSP, mesh, "position", 3,
         water->data->w * water->data->h);
-    setupIdxVbo(water->drawSP, idx, water->idxCnt);
+    water->drawIdxVboP = setupIdxVbo(water->drawSP, idx, water->idxCnt);
+
+    free(mesh);
+    free(idx);
 
     CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
 }
 
-void setupMeshUniforms(Water * water)
+void initDrawWaterShaderProgram(Water * water)
 {
-    int w = water->data->w;
-    int h = water->data->h;
+    water->drawSP = getShaderProgram("draw_water_vshader.glsl",
+        NULL, "draw_water_fshader.glsl");
 
+    glGenVertexArrays(1, &(water->drawVaoP));
+
+    setupDrawMesh(water);
+}
+
+void setupMeshUniforms(Water * water)
+{
     float sizeX = water->data->lastX - water->data->firstX;
     float sizeY = water->data->lastY - water->data->firstY;
 
@@ -145,10 +485,6 @@ void setupMeshUniforms(Water * water)
 
     glUseProgram(water->modifySP->p);
 
-    obj = glGetUniformLocation(water->modifySP->p, "meshTexStep");
-    /* TODO: if (obj == -1) {} */
-    glUniform2f(obj, 1.0f / (w - 1), 1.0f / (h - 1));
-
     obj = glGetUniformLocation(water->modifySP->p, "meshViewFirst");
     /* TODO: if (obj == -1) {} */
     glUniform2f(obj, water->data->firstX, water->data->firstY);
@@ -157,27 +493,62 @@ void setupMeshUniforms(Water * water)
     /* TODO: if (obj == -1) {} */
     glUniform2f(obj, sizeX, sizeY);
 
-    obj = glGetUniformLocation(water->modifySP->p, "meshZ");
+    glUseProgram(water->drawSP->p);
+
+    obj = glGetUniformLocation(water->drawSP->p, "meshViewFirst");
+    /* TODO: if (obj == -1) {} */
+    glUniform2f(obj, water->data->firstX, water->data->firstY);
+
+    obj = glGetUniformLocation(water->drawSP->p, "meshViewSize");
+    /* TODO: if (obj == -1) {} */
+    glUniform2f(obj, sizeX, sizeY);
+
+    obj = glGetUniformLocation(water->drawSP->p, "meshZ");
     /* TODO: if (obj == -1) {} */
     glUniform1f(obj, water->data->z);
 
-    obj = glGetUniformLocation(water->modifySP->p, "makeWave");
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+    glUseProgram(0);
+}
+
+/* Uniforms which depend on simulation grid size and format. */
+void setupSimUniforms(Water * water)
+{
+    GLuint obj;
+
+    glUseProgram(water->modifySP->p);
+
+    obj = glGetUniformLocation(water->modifySP->p, "packedVelocity");
     /* TODO: if (obj == -1) {} */
-    glUniform1i(obj, GL_FALSE);
+    glUniform1i(obj, formatInfo[water->format].packed);
 
-    glUseProgram(water->drawSP->p);
+    obj = glGetUniformLocation(water->modifySP->p, "simSize");
+    /* TODO: if (obj == -1) {} */
+    glUniform2f(obj, water->simW, water->simH);
 
-    obj = glGetUniformLocation(water->drawSP->p, "meshTexStep");
+    obj = glGetUniformLocation(water->modifySP->p, "tileSize");
     /* TODO: if (obj == -1) {} */
-    glUniform2f(obj, 1.0f / (w - 1), 1.0f / (h - 1));
+    glUniform1i(obj, WATER_TILE_SIZE);
 
-    obj = glGetUniformLocation(water->drawSP->p, "meshViewFirst");
+    glUseProgram(water->measureSP->p);
+
+    obj = glGetUniformLocation(water->measureSP->p, "packedVelocity");
     /* TODO: if (obj == -1) {} */
-    glUniform2f(obj, water->data->firstX, water->data->firstY);
+    glUniform1i(obj, formatInfo[water->format].packed);
 
-    obj = glGetUniformLocation(water->drawSP->p, "meshViewSize");
+    obj = glGetUniformLocation(water->measureSP->p, "tilesSize");
     /* TODO: if (obj == -1) {} */
-    glUniform2f(obj, sizeX, sizeY);
+    glUniform2f(obj, water->tiles.w, water->tiles.h);
+
+    obj = glGetUniformLocation(water->measureSP->p, "tileSize");
+    /* TODO: if (obj == -1) {} */
+    glUniform1i(obj, WATER_TILE_SIZE);
+
+    glUseProgram(water->drawSP->p);
+
+    obj = glGetUniformLocation(water->drawSP->p, "simTexStep");
+    /* TODO: if (obj == -1) {} */
+    glUniform2f(obj, 1.0f / water->simW, 1.0f / water->simH);
 
     CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
     glUseProgram(0);
@@ -194,7 +565,7 @@ void setupWorldUniforms(ShaderProgram * sp, Water * water)
 
     obj = glGetUniformLocation(sp->p, "texGeometry");
     /* TODO: if (obj == -1) {} */
-    glUniform1i(obj, 4);
+    glUniform1i(obj, WATER_GEOMETRY_UNIT);
 
     obj = glGetUniformLocation(sp->p, "meshViewFirst");
     /* TODO: if (obj == -1) {} */
@@ -204,6 +575,10 @@ void setupWorldUniforms(ShaderProgram * sp, Water * water)
     /* TODO: if (obj == -1) {} */
     glUniform2f(obj, sizeX, sizeY);
 
+    obj = glGetUniformLocation(sp->p, "meshZ");
+    /* TODO: if (obj == -1) {} */
+    glUniform1f(obj, water->data->z);
+
     CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
     glUseProgram(0);
 }
@@ -212,53 +587,117 @@ void setupTextureUniforms(Water * water)
 {
     GLuint obj;
 
+    /* Set for each step by modifyWaterMeshStep(). */
+    water->texFstLoc = glGetUniformLocation(water->modifySP->p, "texFst");
+    /* TODO: if (water->texFstLoc == -1) {} */
+    water->texSndLoc = glGetUniformLocation(water->modifySP->p, "texSnd");
+    /* TODO: if (water->texSndLoc == -1) {} */
+    water->tiledLoc = glGetUniformLocation(water->modifySP->p, "tiled");
+    /* TODO: if (water->tiledLoc == -1) {} */
+    water->impulseCntLoc =
+        glGetUniformLocation(water->modifySP->p, "impulseCnt");
+    /* TODO: if (water->impulseCntLoc == -1) {} */
+
     glUseProgram(water->modifySP->p);
 
-    obj = glGetUniformLocation(water->modifySP->p, "texFst");
+    obj = glGetUniformLocation(water->modifySP->p, "texImpulses");
     /* TODO: if (obj == -1) {} */
-    glUniform1i(obj, 2);
+    glUniform1i(obj, WATER_IMPULSES_UNIT);
+    glUniform1i(water->impulseCntLoc, 0);
 
-    obj = glGetUniformLocation(water->modifySP->p, "texSnd");
-    /* TODO: if (obj == -1) {} */
-    glUniform1i(obj, 3);
+    /* Set for each measure by measureTiles(). */
+    water->tiles.texDstLoc =
+        glGetUniformLocation(water->measureSP->p, "texDst");
+    /* TODO: if (water->tiles.texDstLoc == -1) {} */
+    water->tiles.texSndLoc =
+        glGetUniformLocation(water->measureSP->p, "texSnd");
+    /* TODO: if (water->tiles.texSndLoc == -1) {} */
 
     glUseProgram(water->drawSP->p);
 
     obj = glGetUniformLocation(water->drawSP->p, "texGeometry");
     /* TODO: if (obj == -1) {} */
-    glUniform1i(obj, 4);
+    glUniform1i(obj, WATER_GEOMETRY_UNIT);
+
+    obj = glGetUniformLocation(water->drawSP->p, "texNormals");
+    /* TODO: if (obj == -1) {} */
+    glUniform1i(obj, WATER_NORMALS_UNIT);
+
+    obj = glGetUniformLocation(water->drawSP->p, "texShadeColor");
+    /* TODO: if (obj == -1) {} */
+    glUniform1i(obj, WATER_SHADE_COLOR_UNIT);
+
+    obj = glGetUniformLocation(water->drawSP->p, "texShadeGuide");
+    /* TODO: if (obj == -1) {} */
+    glUniform1i(obj, WATER_SHADE_GUIDE_UNIT);
+
+    /* Set for each pass by drawWater(). */
+    water->shade.passLoc =
+        glGetUniformLocation(water->drawSP->p, "shadePass");
+    /* TODO: if (water->shade.passLoc == -1) {} */
+    glUniform1i(water->shade.passLoc, 0);
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+}
+
+void setupNormalMapUniforms(Water * water)
+{
+    GLuint obj;
+
+    glUseProgram(water->modifySP->p);
+
+    obj = glGetUniformLocation(water->modifySP->p, "normalMap");
+    /* TODO: if (obj == -1) {} */
+    glUniform1i(obj, water->normalMap);
+
+    glUseProgram(water->drawSP->p);
+
+    obj = glGetUniformLocation(water->drawSP->p, "normalMap");
+    /* TODO: if (obj == -1) {} */
+    glUniform1i(obj, water->normalMap);
 
     CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+    glUseProgram(0);
 }
 
 Water * getWater()
 {
     Water * water = (Water *) malloc(sizeof(Water));
 
-    GLfloat * mesh;
-    GLuint * idx;
-
     initWaterMeshData(water);
 
-    mesh = meshGenVertices(water->data);
-    water->idxCnt = meshGenIdx(water->data, &idx);
-
-    initModifyWaterShaderProgram(water, mesh, idx);
-    initDrawWaterShaderProgram(water, mesh, idx);
+    initModifyWaterShaderProgram(water);
+    initDrawWaterShaderProgram(water);
+    initRainShaderProgram(water);
 
     setupMeshUniforms(water);
 
     genTextures(water);
+    genFramebuffers(water);
+    genTiles(water);
+    genImpulses(water);
+
+    water->sparse = GL_TRUE;
+    water->sleeping = GL_FALSE;
 
     setupTextureUniforms(water);
+    setupSimUniforms(water);
+    setupNormalMapUniforms(water);
 
-    water->firstTexture = 2;
-    rotateTextures(water);
-
-    free(mesh);
-    free(idx);
+    water->firstTexture = 0;
+    bindTextures(water);
+    bindLastTexture(water);
 
     water->dSecondSum = 0.0f;
+    water->stepCnt = 0;
+
+    glGenQueries(2, water->drawQueryIds);
+    water->drawQueryCnt = 0;
+    water->drawSeconds = 0.0f;
+
+    water->shade.w = 0;
+    water->shade.h = 0;
+    setWaterShadeScale(water, 1);
 
     return water;
 }
@@ -292,72 +731,664 @@ void restoreRenderState(const RenderState * state)
     }
 }
 
-void modifyWaterMeshStep(Water * water)
+/* Program, vertex array and viewport are set up by modifyWaterMesh(),
+ * so step only switches framebuffer and samplers. */
+void modifyWaterMeshStep(Water * water, GLboolean tiled)
+{
+    int fst = water->firstTexture;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, water->fboIds[fst]);
+
+    /* texFst is not used by packed formats. */
+    glUniform1i(water->texFstLoc, WATER_HEIGHTS_UNIT + fst);
+    glUniform1i(water->texSndLoc,
+        WATER_HEIGHTS_UNIT + getSndTexture(water, fst));
+
+    /* Sleeping tiles keep old heights, they differ from current ones
+     * less than activityMin of format. */
+    if (tiled)
+    {
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 6, water->tiles.activeCnt);
+    }
+    else
+    {
+        /* Triangle covers all viewport, so no need in glClear(). */
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+}
+
+/* Drops of current step are added to its destination texture, which
+ * is attached to current framebuffer. */
+void rainWaterStep(Water * water)
+{
+    WaterRain * rain = &(water->rain);
+    int dropCnt;
+
+    rain->dropSum += rain->dropsPerSecond * WATER_STEP_SECONDS;
+    dropCnt = (int) rain->dropSum;
+    rain->dropSum -= dropCnt;
+
+    glUseProgram(rain->sp->p);
+    glUniform1ui(rain->stepLoc, rain->stepCnt);
+    glBindVertexArray(rain->vaoP);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, dropCnt);
+    glDisable(GL_BLEND);
+
+    glUseProgram(water->modifySP->p);
+    glBindVertexArray(water->modifyVaoP);
+
+    ++(rain->stepCnt);
+}
+
+/* Marks tiles of rectangle [x0; x1] x [y0; y1] in texels, returns
+ * count of marked tiles. */
+static int markTexelRect(WaterTiles * tiles, float x0, float y0,
+    float x1, float y1)
+{
+    int tx0 = (int) floor(x0 / WATER_TILE_SIZE);
+    int ty0 = (int) floor(y0 / WATER_TILE_SIZE);
+    int tx1 = (int) floor(x1 / WATER_TILE_SIZE);
+    int ty1 = (int) floor(y1 / WATER_TILE_SIZE);
+    int x, y;
+    int cnt = 0;
+
+    tx0 = (tx0 < 0) ? 0 : tx0;
+    ty0 = (ty0 < 0) ? 0 : ty0;
+    tx1 = (tx1 >= tiles->w) ? tiles->w - 1 : tx1;
+    ty1 = (ty1 >= tiles->h) ? tiles->h - 1 : ty1;
+
+    for (y = ty0; y <= ty1; ++y)
+    {
+        for (x = tx0; x <= tx1; ++x)
+        {
+            tiles->marks[y * tiles->w + x] = 1;
+            ++cnt;
+        }
+    }
+
+    return cnt;
+}
+
+/* The same as hash() of rain_water_vshader.glsl. */
+static unsigned int hashRain(unsigned int x)
+{
+    x &= 0xffffffffu;
+    x ^= x >> 16;
+    x = (x * 0x7feb352du) & 0xffffffffu;
+    x ^= x >> 15;
+    x = (x * 0x846ca68bu) & 0xffffffffu;
+    x ^= x >> 16;
+
+    return x;
+}
+
+/* Marks tiles disturbed in batch of stepCnt steps: with activity above
+ * activityMin of format, under impulses the batch takes and under rain
+ * drops of the batch (drops are made by the same hash and counted as
+ * rainWaterStep() does). Returns count of marked tiles. */
+static int markTiles(Water * water, const GLfloat * activity,
+    int stepCnt)
+{
+    WaterTiles * tiles = &(water->tiles);
+    WaterRain * rain = &(water->rain);
+    const MeshData * data = water->data;
+    float scaleX = water->simW / (data->lastX - data->firstX);
+    float scaleY = water->simH / (data->lastY - data->firstY);
+    int impulseCnt = stepCnt * WATER_IMPULSES_PER_STEP;
+    int cnt = 0;
+    int i;
+
+    for (i = 0; i < tiles->w * tiles->h; ++i)
+    {
+        tiles->marks[i] =
+            (activity[i] > formatInfo[water->format].activityMin);
+        cnt += tiles->marks[i];
+    }
+
+    impulseCnt = (water->impulseCnt < impulseCnt) ?
+        water->impulseCnt : impulseCnt;
+
+    for (i = 0; i < impulseCnt; ++i)
+    {
+        const GLfloat * impulse = water->impulses + i * 4;
+
+        cnt += markTexelRect(tiles,
+            (impulse[0] - impulse[2] - data->firstX) * scaleX,
+            (impulse[1] - impulse[2] - data->firstY) * scaleY,
+            (impulse[0] + impulse[2] - data->firstX) * scaleX,
+            (impulse[1] + impulse[2] - data->firstY) * scaleY);
+    }
+
+    if (rain->dropsPerSecond > 0.0f)
+    {
+        float dropSum = rain->dropSum;
+        float radiusX = rain->dropRadius * scaleX;
+        float radiusY = rain->dropRadius * scaleY;
+        int step;
+
+        for (step = 0; step < stepCnt; ++step)
+        {
+            unsigned int stepHash = hashRain(rain->seed ^
+                hashRain(rain->stepCnt + step));
+            int dropCnt;
+
+            dropSum += rain->dropsPerSecond * WATER_STEP_SECONDS;
+            dropCnt = (int) dropSum;
+            dropSum -= dropCnt;
+
+            for (i = 0; i < dropCnt; ++i)
+            {
+                unsigned int h = hashRain(stepHash + i);
+                float x = (h & 0xffffu) / 65535.0f * water->simW;
+                float y = (h >> 16) / 65535.0f * water->simH;
+
+                cnt += markTexelRect(tiles, x - radiusX, y - radiusY,
+                    x + radiusX, y + radiusY);
+            }
+        }
+    }
+
+    return cnt;
+}
+
+/* Active tiles for batch of stepCnt steps: tiles disturbed by activity
+ * from last measure, by impulses or by rain, and tiles the waves reach
+ * from them. All tiles are active, if the measure is not ready, normal
+ * map is stale or simulation is not sparse. If nothing is disturbed,
+ * whole simulation falls asleep. */
+void updateTiles(Water * water, int stepCnt)
+{
+    WaterTiles * tiles = &(water->tiles);
+    const GLfloat * activity = NULL;
+    const unsigned char * marks = NULL;
+    GLboolean ready = tiles->activityKept;
+
+    /* Wave front moves at most one texel per step. */
+    int radius = (stepCnt + WATER_TILE_SIZE - 1) / WATER_TILE_SIZE;
+
+    if (tiles->activityFence != 0)
+    {
+        GLenum status = glClientWaitSync(tiles->activityFence, 0, 0);
+
+        ready = (status == GL_ALREADY_SIGNALED ||
+            status == GL_CONDITION_SATISFIED);
+
+        glDeleteSync(tiles->activityFence);
+        tiles->activityFence = 0;
+    }
+
+    tiles->activityKept = GL_FALSE;
+
+    if (ready && !(water->normalMap && water->normalsStale))
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, tiles->activityPboP);
+        activity = (const GLfloat *) glMapBufferRange(GL_PIXEL_PACK_BUFFER,
+            0, tiles->w * tiles->h * sizeof(GLfloat), GL_MAP_READ_BIT);
+    }
+
+    if (activity != NULL)
+    {
+        water->sleeping = (markTiles(water, activity, stepCnt) == 0);
+        tiles->activityKept = water->sleeping;
+        marks = water->sparse ? tiles->marks : NULL;
+
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    selectTiles(water, marks, radius);
+}
+
+/* Activity of tiles which were stepped, others keep old activity. Read
+ * back asynchronously, see updateTiles(). */
+void measureTiles(Water * water)
+{
+    WaterTiles * tiles = &(water->tiles);
+
+    glUseProgram(water->measureSP->p);
+
+    glUniform1i(tiles->texDstLoc, WATER_HEIGHTS_UNIT +
+        getDstTexture(water, water->firstTexture));
+    glUniform1i(tiles->texSndLoc, WATER_HEIGHTS_UNIT +
+        getSndTexture(water, water->firstTexture));
+
+    glBindVertexArray(tiles->measureVaoP);
+    glBindFramebuffer(GL_FRAMEBUFFER, tiles->activityFboId);
+    glViewport(0, 0, tiles->w, tiles->h);
+
+    glDrawArrays(GL_POINTS, 0, tiles->activeCnt);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, tiles->activityPboP);
+    glReadPixels(0, 0, tiles->w, tiles->h, GL_RED, GL_FLOAT,
+        (GLvoid *) 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    tiles->activityFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void modifyWaterMesh(Water * water, float dSecond)
 {
     RenderState state;
+    GLboolean tiled = GL_FALSE;
+    float dSecondSum;
+    int stepCnt = 0;
+
+    water->dSecondSum += dSecond;
+    water->stepCnt = 0;
+
+    for (dSecondSum = water->dSecondSum; dSecondSum > WATER_STEP_SECONDS;
+        dSecondSum -= WATER_STEP_SECONDS)
+    {
+        ++stepCnt;
+    }
+
+    if (stepCnt == 0)
+    {
+        return;
+    }
+
+    /* Nothing to step till next wave. */
+    if (!water->sleeping)
+    {
+        updateTiles(water, stepCnt);
+    }
+
+    if (water->sleeping)
+    {
+        water->dSecondSum = dSecondSum;
+        return;
+    }
+
+    tiled = (water->tiles.activeCnt < water->tiles.w * water->tiles.h);
 
     saveRenderState(&state);
 
     glUseProgram(water->modifySP->p);
+    glUniform1i(water->tiledLoc, tiled);
     glBindVertexArray(water->modifyVaoP);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, water->fboId);
-
-    glViewport(0, 0, water->data->w, water->data->h);
+    glViewport(0, 0, water->simW, water->simH);
     glDisable(GL_DEPTH_TEST);
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    while (water->stepCnt < stepCnt)
+    {
+        water->firstTexture = (water->firstTexture + 1) % water->textureCnt;
+        takeImpulses(water);
+        modifyWaterMeshStep(water, tiled);
+        ++(water->stepCnt);
+
+        if (water->rain.dropsPerSecond > 0.0f)
+        {
+            rainWaterStep(water);
+        }
+    }
+
+    water->dSecondSum = dSecondSum;
+
+    if (water->normalMap)
+    {
+        water->normalsStale = GL_FALSE;
+    }
 
-    glDrawElements(GL_TRIANGLES, water->idxCnt,
-        GL_UNSIGNED_INT, NULL);
+    measureTiles(water);
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    bindLastTexture(water);
 
     restoreRenderState(&state);
 
     CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
 }
 
-void modifyWaterMesh(Water * water, float dSecond)
+void setWaterWave(Water * water, const Camera * camera)
 {
+    const MeshData * data = water->data;
+    vec3 back = {0.0f, 0.0f, 1.0f};
+    vec3 ray;
+    mat4 rot;
+    float k, x, y;
+
+    /* Camera looks along -ray. */
+    setMatrixFromQuaternion(rot, camera->q);
+    transposeMatrix(rot);
+    setMulMatrixVec3(ray, rot, back);
+
+    /* Surface is taken at rest level, so wave from above water is made
+     * from above even if camera is lower than crest under it. */
+    if ((camera->pos[2] > data->z) != (ray[2] > 0.0f) || ray[2] == 0.0f)
+    {
+        return;
+    }
+
+    k = (data->z - camera->pos[2]) / ray[2];
+    x = camera->pos[0] + ray[0] * k;
+    y = camera->pos[1] + ray[1] * k;
+
+    if (x < data->firstX || x > data->lastX ||
+        y < data->firstY || y > data->lastY)
+    {
+        return;
+    }
+
+    addWaterImpulse(water, x, y, WATER_WAVE_RADIUS,
+        (ray[2] > 0.0f) ? WATER_WAVE_HEIGHT : -WATER_WAVE_HEIGHT);
+}
+
+void addWaterImpulse(Water * water, float x, float y, float radius,
+    float height)
+{
+    GLfloat * impulse;
+
+    if (water->impulseCnt == water->impulseMax)
+    {
+        water->impulseMax *= 2;
+        water->impulses = (GLfloat *) realloc(water->impulses,
+            water->impulseMax * 4 * sizeof(GLfloat));
+    }
+
+    impulse = water->impulses + water->impulseCnt * 4;
+    impulse[0] = x;
+    impulse[1] = y;
+    impulse[2] = radius;
+    impulse[3] = height;
+
+    ++(water->impulseCnt);
+    water->sleeping = GL_FALSE;
+}
+
+void setWaterRain(Water * water, float dropsPerSecond, float dropRadius,
+    unsigned int seed)
+{
+    WaterRain * rain = &(water->rain);
     GLuint obj;
 
-    water->dSecondSum += dSecond;
+    rain->dropsPerSecond = dropsPerSecond;
+    rain->dropRadius = dropRadius;
+    rain->seed = seed;
+    rain->stepCnt = 0;
+
+    glUseProgram(rain->sp->p);
 
-    while (water->dSecondSum > 0.05f)
+    obj = glGetUniformLocation(rain->sp->p, "dropRadius");
+    /* TODO: if (obj == -1) {} */
+    glUniform1f(obj, dropRadius);
+
+    obj = glGetUniformLocation(rain->sp->p, "seed");
+    /* TODO: if (obj == -1) {} */
+    glUniform1ui(obj, seed);
+
+    if (dropsPerSecond > 0.0f)
     {
-        rotateTextures(water);
-        modifyWaterMeshStep(water);
-        water->dSecondSum -= 0.05f;
+        water->sleeping = GL_FALSE;
+    }
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+}
+
+/* Recreates heights textures with new size and format. Current waves
+ * are scaled to new grid. When count of textures is changed, only last
+ * heights are kept (velocity is lost). */
+static void regenTextures(Water * water, int w, int h, WaterFormat format)
+{
+    GLuint * oldTextureIds = water->textureIds;
+    GLuint oldNormalTextureId = water->normalTextureId;
+    int oldTextureCnt = water->textureCnt;
+    int oldLast = getDstTexture(water, water->firstTexture);
+    int oldW = water->simW;
+    int oldH = water->simH;
+    GLuint blitFboIds[2];
+    int i;
+
+    glDeleteFramebuffers(water->textureCnt, water->fboIds);
+
+    water->simW = w;
+    water->simH = h;
+    water->format = format;
+
+    genTextures(water);
+
+    if (water->textureCnt != oldTextureCnt)
+    {
+        water->firstTexture = 0;
+    }
+
+    glGenFramebuffers(2, blitFboIds);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, blitFboIds[0]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, blitFboIds[1]);
+
+    for (i = 0; i < water->textureCnt; ++i)
+    {
+        int src = (water->textureCnt == oldTextureCnt) ? i : oldLast;
+
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+            GL_TEXTURE_2D, oldTextureIds[src], 0);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+            GL_TEXTURE_2D, water->textureIds[i], 0);
+
+        /* Missing components (velocity) are read as zero. */
+        glBlitFramebuffer(0, 0, oldW, oldH, 0, 0, w, h,
+            GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(2, blitFboIds);
+
+    glDeleteTextures(oldTextureCnt, oldTextureIds);
+    free(oldTextureIds);
+    glDeleteTextures(1, &oldNormalTextureId);
+
+    genFramebuffers(water);
+
+    freeTiles(water);
+    genTiles(water);
+
+    bindTextures(water);
+    bindLastTexture(water);
 
-        obj = glGetUniformLocation(water->modifySP->p, "makeWave");
-        /* TODO: if (obj == -1) {} */
-        glUniform1i(obj, GL_FALSE);
+    setupSimUniforms(water);
+}
+
+void setWaterSimSize(Water * water, int w, int h)
+{
+    regenTextures(water, w, h, water->format);
+}
+
+void setWaterFormat(Water * water, WaterFormat format)
+{
+    regenTextures(water, water->simW, water->simH, format);
+}
+
+const char * getWaterFormatName(WaterFormat format)
+{
+    return formatInfo[format].name;
+}
+
+int getWaterTexturesBytes(const Water * water)
+{
+    return water->textureCnt * water->simW * water->simH *
+        formatInfo[water->format].texelBytes;
+}
+
+void setWaterSparse(Water * water, GLboolean sparse)
+{
+    water->sparse = sparse;
 
-        CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+    selectTiles(water, NULL, 0);
+}
+
+void setWaterNormalMap(Water * water, GLboolean normalMap)
+{
+    water->normalMap = normalMap;
+
+    /* Sleeping tiles are not stepped, so they would keep old normals. */
+    if (normalMap)
+    {
+        water->normalsStale = GL_TRUE;
+        water->sleeping = GL_FALSE;
     }
+
+    setupDrawBuffers(water);
+    setupNormalMapUniforms(water);
 }
 
-void setWaterWave(Water * water)
+void setWaterShadeScale(Water * water, int scale)
 {
     GLuint obj;
 
-    glUseProgram(water->modifySP->p);
+    water->shade.scale = scale;
 
-    obj = glGetUniformLocation(water->modifySP->p, "makeWave");
+    glUseProgram(water->drawSP->p);
+
+    obj = glGetUniformLocation(water->drawSP->p, "shadeScale");
     /* TODO: if (obj == -1) {} */
-    glUniform1i(obj, GL_TRUE);
+    glUniform1f(obj, (GLfloat) scale);
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+    glUseProgram(0);
+}
+
+void genShadeBuffer(Water * water, int w, int h)
+{
+    WaterShade * shade = &(water->shade);
+    const GLenum drawBuffers[] =
+        {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+
+    shade->w = w;
+    shade->h = h;
+
+    shade->colorTextureId = createTexture(w, h, GL_RGBA8, NULL);
+    shade->guideTextureId = createTexture(w, h, GL_RGBA16F, NULL);
+
+    glGenRenderbuffers(1, &(shade->depthRenderbufferId));
+    glBindRenderbuffer(GL_RENDERBUFFER, shade->depthRenderbufferId);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &(shade->fboId));
+    glBindFramebuffer(GL_FRAMEBUFFER, shade->fboId);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, shade->colorTextureId, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+        GL_TEXTURE_2D, shade->guideTextureId, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+        GL_RENDERBUFFER, shade->depthRenderbufferId);
+    glDrawBuffers(2, drawBuffers);
+
+    checkFramebufferStatus();
+
+    glActiveTexture(GL_TEXTURE0 + WATER_SHADE_COLOR_UNIT);
+    glBindTexture(GL_TEXTURE_2D, shade->colorTextureId);
+    glActiveTexture(GL_TEXTURE0 + WATER_SHADE_GUIDE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, shade->guideTextureId);
+    glActiveTexture(GL_TEXTURE0);
 
     CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
 }
 
-void drawWater(const Water * water)
+void freeShadeBuffer(Water * water)
+{
+    WaterShade * shade = &(water->shade);
+
+    if (shade->w == 0)
+    {
+        return;
+    }
+
+    glDeleteFramebuffers(1, &(shade->fboId));
+    glDeleteRenderbuffers(1, &(shade->depthRenderbufferId));
+    glDeleteTextures(1, &(shade->colorTextureId));
+    glDeleteTextures(1, &(shade->guideTextureId));
+
+    shade->w = 0;
+    shade->h = 0;
+}
+
+void setWaterMeshSize(Water * water, int w, int h)
+{
+    glDeleteBuffers(1, &(water->drawVboP));
+    glDeleteBuffers(1, &(water->drawIdxVboP));
+
+    water->data->w = w;
+    water->data->h = h;
+
+    setupDrawMesh(water);
+}
+
+/* Reflection and refraction to reduced buffer, then composite with
+ * lighting to current framebuffer. Program and vertex array are set up
+ * by drawWater(). */
+void drawWaterReduced(Water * water)
+{
+    WaterShade * shade = &(water->shade);
+    const GLfloat zero[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    const GLfloat one = 1.0f;
+    RenderState state;
+    GLint fboId;
+    int w, h;
+
+    saveRenderState(&state);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &fboId);
+
+    w = (state.viewport[2] + shade->scale - 1) / shade->scale;
+    h = (state.viewport[3] + shade->scale - 1) / shade->scale;
+
+    if (w != shade->w || h != shade->h)
+    {
+        freeShadeBuffer(water);
+        genShadeBuffer(water, w, h);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, shade->fboId);
+    glViewport(0, 0, w, h);
+
+    glClearBufferfv(GL_COLOR, 0, zero);
+    glClearBufferfv(GL_COLOR, 1, zero);
+    glClearBufferfv(GL_DEPTH, 0, &one);
+
+    glUniform1i(shade->passLoc, 1);
+    glDrawElements(GL_TRIANGLES, water->idxCnt, GL_UNSIGNED_INT, NULL);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+    restoreRenderState(&state);
+
+    glUniform1i(shade->passLoc, 2);
+    glDrawElements(GL_TRIANGLES, water->idxCnt, GL_UNSIGNED_INT, NULL);
+}
+
+void drawWater(Water * water)
 {
+    GLuint queryId = water->drawQueryIds[water->drawQueryCnt % 2];
+
+    if (water->drawQueryCnt >= 2)
+    {
+        GLuint64 ns;
+
+        glGetQueryObjectui64v(queryId, GL_QUERY_RESULT, &ns);
+        water->drawSeconds = ns / 1e9f;
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, queryId);
+
     glUseProgram(water->drawSP->p);
     glBindVertexArray(water->drawVaoP);
 
-    glDrawElements(GL_TRIANGLES, water->idxCnt,
-        GL_UNSIGNED_INT, NULL);
+    if (water->shade.scale > 1)
+    {
+        drawWaterReduced(water);
+    }
+    else
+    {
+        glUniform1i(water->shade.passLoc, 0);
+        glDrawElements(GL_TRIANGLES, water->idxCnt,
+            GL_UNSIGNED_INT, NULL);
+    }
+
+    glEndQuery(GL_TIME_ELAPSED);
+    ++(water->drawQueryCnt);
 }
 
 void freeWater(Water * water)
@@ -367,11 +1398,26 @@ void freeWater(Water * water)
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glBindTexture(GL_TEXTURE_2D, 0);
 
-    glDeleteTextures(1, &(water->textureIds[0]));
-    glDeleteTextures(1, &(water->textureIds[1]));
-    glDeleteTextures(1, &(water->textureIds[2]));
+    glDeleteTextures(water->textureCnt, water->textureIds);
+    glDeleteTextures(1, &(water->normalTextureId));
 
     free(water->textureIds);
 
-    glDeleteFramebuffers(1, &(water->fboId));
+    glDeleteFramebuffers(water->textureCnt, water->fboIds);
+
+    glDeleteBuffers(1, &(water->drawVboP));
+    glDeleteBuffers(1, &(water->drawIdxVboP));
+
+    freeTiles(water);
+    glDeleteBuffers(1, &(water->tiles.vboP));
+
+    free(water->impulses);
+    glDeleteTextures(1, &(water->impulseTextureId));
+    glDeleteBuffers(1, &(water->impulseTboP));
+
+    glDeleteVertexArrays(1, &(water->rain.vaoP));
+
+    glDeleteQueries(2, water->drawQueryIds);
+
+    freeShadeBuffer(water);
 }
@@ -3,27 +3,194 @@
 
 #include "shaders.h"
 #include "mesh.h"
+#include "camera.h"
+
+/* Storage of heights textures, heights are relative to data->z. */
+typedef
+enum WaterFormat
+{
+    /* Height in .r, three textures rotated (fst, snd, dst). */
+    WATER_FORMAT_RGBA32F,
+    WATER_FORMAT_R32F,
+    WATER_FORMAT_R16F,
+    /* Height in .r and velocity in .g, two textures. */
+    WATER_FORMAT_RG32F,
+    WATER_FORMAT_RG16F,
+    WATER_FORMATS_CNT
+}
+WaterFormat;
+
+/* Grid is splitted into tiles. Activity of tiles is measured after each
+ * batch of steps and read back by next batch. Sparse simulation steps
+ * only active tiles. */
+typedef
+struct WaterTiles
+{
+    /* Size of tiles grid. */
+    int w;
+    int h;
+
+    /* Tile coordinates (x, y) of active tiles, uploaded to vboP. */
+    GLint * active;
+    int activeCnt;
+
+    /* Scratch for selection of active tiles, w * h values. */
+    unsigned char * marks;
+
+    GLuint vboP;
+    GLuint measureVaoP;
+
+    /* Uniform locations in measureSP. */
+    GLint texDstLoc;
+    GLint texSndLoc;
+
+    /* Activity of each tile, one texel per tile. */
+    GLuint activityTextureId;
+    GLuint activityFboId;
+    GLuint activityPboP;
+
+    /* Readback of last measure, 0 -- nothing to read. */
+    GLsync activityFence;
+
+    /* Simulation fell asleep by last readback, nothing is stepped since,
+     * so activityPboP is still actual for the batch which wakes it. */
+    GLboolean activityKept;
+}
+WaterTiles;
+
+/* Rain: random drops are splatted into destination texture after each
+ * step by one instanced draw, however many drops there are. */
+typedef
+struct WaterRain
+{
+    /* 0 -- no rain. */
+    float dropsPerSecond;
+
+    /* In world coordinates. */
+    float dropRadius;
+
+    unsigned int seed;
+
+    /* Fraction of drop which is not fallen yet. */
+    float dropSum;
+
+    /* Steps made in rain, drops of each step are different. */
+    unsigned int stepCnt;
+
+    ShaderProgram * sp;
+    GLuint vaoP;
+
+    /* Uniform location in sp. */
+    GLint stepLoc;
+}
+WaterRain;
+
+/* Reflection and refraction are shaded into buffer reduced scale times
+ * and upsampled to full resolution by distance and normal, see
+ * draw_water_fshader.glsl. */
+typedef
+struct WaterShade
+{
+    /* 1 -- all is shaded at full resolution. */
+    int scale;
+
+    /* Size of buffer, 0 -- not created yet. It is recreated by draw when
+     * viewport or scale is changed. */
+    int w;
+    int h;
+
+    GLuint fboId;
+    /* Reflection and refraction color. */
+    GLuint colorTextureId;
+    /* Normal and distance to camera, 0 -- no water. */
+    GLuint guideTextureId;
+    GLuint depthRenderbufferId;
+
+    /* Uniform location in drawSP. */
+    GLint passLoc;
+}
+WaterShade;
 
 typedef
 struct Water
 {
+    /* Render mesh: data->w x data->h vertices. */
     MeshData * data;
 
+    /* Simulation grid: simW x simH texels, independent of render mesh. */
+    int simW;
+    int simH;
+    WaterFormat format;
+
     ShaderProgram * modifySP;
     ShaderProgram * drawSP;
+    ShaderProgram * measureSP;
 
     GLuint modifyVaoP;
     GLuint drawVaoP;
+    GLuint drawVboP;
+    GLuint drawIdxVboP;
 
-    GLuint fboId;
+    /* Framebuffer for each firstTexture value, its color attachment is
+     * destination texture of step. */
+    GLuint fboIds[3];
 
     int firstTexture;
+    int textureCnt;
     GLuint * textureIds;
 
-    /* For gen and for draw data */
+    /* Gradients of heights (see calcNormal() in draw shaders), written
+     * by step to second color attachment of fboIds. They are computed
+     * from heights which step reads, so they are one step behind. Draw
+     * samples them instead of neighbour heights. */
+    GLboolean normalMap;
+    GLuint normalTextureId;
+
+    /* Normal map is not written since last resize or switching on, next
+     * batch steps all tiles. */
+    GLboolean normalsStale;
+
+    /* Uniform locations in modifySP. */
+    GLint texFstLoc;
+    GLint texSndLoc;
+    GLint impulseCntLoc;
+    GLint tiledLoc;
+
+    /* Queue of impulses (x, y, radius, height) in world coordinates,
+     * 4 values each. Next step applies up to WATER_IMPULSES_PER_STEP of
+     * them, the rest waits for following steps. */
+    GLfloat * impulses;
+    int impulseCnt;
+    int impulseMax;
+
+    /* Impulses of current step, buffer texture. */
+    GLuint impulseTextureId;
+    GLuint impulseTboP;
+
+    /* Step only active tiles. */
+    GLboolean sparse;
+    WaterTiles tiles;
+
+    WaterRain rain;
+
+    /* All tiles are quiet, no steps till next wave. */
+    GLboolean sleeping;
+
+    WaterShade shade;
+
+    /* Render mesh indices. */
     GLsizei idxCnt;
 
     float dSecondSum;
+
+    /* Steps made by last modifyWaterMesh() call. */
+    int stepCnt;
+
+    /* GPU time of drawWater(). Two timer queries are used in turn, so
+     * result of frame before previous one is read without waiting. */
+    GLuint drawQueryIds[2];
+    int drawQueryCnt;
+    float drawSeconds;
 }
 Water;
 
@@ -31,9 +198,43 @@ Water * getWater();
 
 void modifyWaterMesh(Water * water, float dSecond);
 
-void setWaterWave(Water * water);
+/* Wave at the point of water surface the camera looks at. */
+void setWaterWave(Water * water, const Camera * camera);
+
+/* height -- full height from down to up wave, negative height makes
+ * wave from under water. */
+void addWaterImpulse(Water * water, float x, float y, float radius,
+    float height);
+
+/* Rain with the same seed makes the same drops. dropsPerSecond == 0 --
+ * no rain. */
+void setWaterRain(Water * water, float dropsPerSecond, float dropRadius,
+    unsigned int seed);
+
+/* Current heights are scaled to new grid. */
+void setWaterSimSize(Water * water, int w, int h);
+
+void setWaterMeshSize(Water * water, int w, int h);
+
+/* Current heights are kept, velocity too if count of textures is
+ * the same. */
+void setWaterFormat(Water * water, WaterFormat format);
+
+const char * getWaterFormatName(WaterFormat format);
+
+void setWaterSparse(Water * water, GLboolean sparse);
+
+void setWaterNormalMap(Water * water, GLboolean normalMap);
+
+/* scale == 1 -- reflection and refraction at full resolution. */
+void setWaterShadeScale(Water * water, int scale);
+
+/* Video memory of heights textures. Each step reads all of them except
+ * dst and writes dst, so it is also memory traffic of one step (without
+ * neighbour fetches, which hit texture cache). */
+int getWaterTexturesBytes(const Water * water);
 
-void drawWater(const Water * water);
+void drawWater(Water * water);
 
 void freeWater(Water * water);
 
@@ -0,0 +1,276 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "water_env.h"
+#include "shaders_errors.h"
+
+/* Cube map is bound to this unit for all time. */
+#define WATER_ENV_UNIT 1
+
+#define WATER_ENV_SIZE 512
+
+#define WATER_ENV_ZNEAR 0.01f
+#define WATER_ENV_ZFAR 100.0f
+
+/* Looks along forward with up vector, as cube map faces expect. */
+typedef
+struct WaterEnvFace
+{
+    GLenum target;
+    vec3 forward;
+    vec3 up;
+}
+WaterEnvFace;
+
+static const WaterEnvFace faces[] =
+{
+    {GL_TEXTURE_CUBE_MAP_POSITIVE_X, {1.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}},
+    {GL_TEXTURE_CUBE_MAP_NEGATIVE_X, {-1.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}},
+    {GL_TEXTURE_CUBE_MAP_POSITIVE_Y, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
+    {GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f, -1.0f}},
+    {GL_TEXTURE_CUBE_MAP_POSITIVE_Z, {0.0f, 0.0f, 1.0f}, {0.0f, -1.0f, 0.0f}},
+    {GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, {0.0f, 0.0f, -1.0f}, {0.0f, -1.0f, 0.0f}}
+};
+
+/* Indexed by WaterRays. */
+static const char * raysNames[] =
+{
+    "trace",
+    "env",
+    "env parallax"
+};
+
+/* Z range of world triangles which are inside water area. */
+static void calcBox(WaterEnv * env, const World * world,
+    const Water * water)
+{
+    const MeshData * data = water->data;
+    const WorldObject * cur;
+    int found = 0;
+    int i, j;
+
+    env->boxMin[0] = data->firstX;
+    env->boxMin[1] = data->firstY;
+    env->boxMax[0] = data->lastX;
+    env->boxMax[1] = data->lastY;
+    env->boxMin[2] = env->boxMax[2] = data->z;
+
+    for (cur = world->objList.first; cur != NULL; cur = cur->next)
+    {
+        if (cur->primitiveType != GL_TRIANGLES)
+        {
+            continue;
+        }
+
+        for (i = 0; i + 2 < cur->idxCnt; i += 3)
+        {
+            int inside = 1;
+
+            for (j = 0; j < 3 && inside; ++j)
+            {
+                const GLfloat * p = cur->position + 3 * cur->idx[i + j];
+
+                inside = (p[0] >= data->firstX && p[0] <= data->lastX &&
+                    p[1] >= data->firstY && p[1] <= data->lastY);
+            }
+
+            for (j = 0; j < 3 && inside; ++j)
+            {
+                const GLfloat * p = cur->position + 3 * cur->idx[i + j];
+
+                env->boxMin[2] = (found && env->boxMin[2] < p[2]) ?
+                    env->boxMin[2] : p[2];
+                env->boxMax[2] = (found && env->boxMax[2] > p[2]) ?
+                    env->boxMax[2] : p[2];
+                found = 1;
+            }
+        }
+    }
+}
+
+/* View of cube face from pos, rows of rotation are right, up and
+ * backward. */
+static void setFaceMatrix(mat4 m, const WaterEnvFace * face,
+    const vec3 pos)
+{
+    mat4 proj, view, tr, viewTr;
+    const float * f = face->forward;
+    const float * u = face->up;
+    vec3 r;
+    int k;
+
+    r[0] = f[1] * u[2] - f[2] * u[1];
+    r[1] = f[2] * u[0] - f[0] * u[2];
+    r[2] = f[0] * u[1] - f[1] * u[0];
+
+    setTranslationMatrix(view, 0.0f, 0.0f, 0.0f);
+
+    for (k = 0; k < 3; ++k)
+    {
+        view[0 + k] = r[k];
+        view[4 + k] = u[k];
+        view[8 + k] = -f[k];
+    }
+
+    setTranslationMatrix(tr, -pos[0], -pos[1], -pos[2]);
+    setMulMatrix(viewTr, view, tr);
+
+    setPerspectiveMatrix(proj, 90.0f, 1.0f,
+        WATER_ENV_ZNEAR, WATER_ENV_ZFAR);
+    setMulMatrix(m, proj, viewTr);
+}
+
+WaterEnv * newWaterEnv(const World * world, const Water * water)
+{
+    WaterEnv * env = (WaterEnv *) malloc(sizeof(WaterEnv));
+    int i;
+
+    calcBox(env, world, water);
+
+    env->pos[0] = (env->boxMin[0] + env->boxMax[0]) / 2.0f;
+    env->pos[1] = (env->boxMin[1] + env->boxMax[1]) / 2.0f;
+    /* So high above the highest triangle inside the pool, that down
+     * face (90 degrees) sees all the pool and objects in the pool hide
+     * little of it. */
+    env->pos[2] = env->boxMax[2] + 0.5f *
+        ((env->boxMax[0] - env->boxMin[0] > env->boxMax[1] - env->boxMin[1]) ?
+        env->boxMax[0] - env->boxMin[0] : env->boxMax[1] - env->boxMin[1]);
+
+    env->size = WATER_ENV_SIZE;
+
+    glGenTextures(1, &(env->cubeTextureId));
+    glActiveTexture(GL_TEXTURE0 + WATER_ENV_UNIT);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, env->cubeTextureId);
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S,
+        GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T,
+        GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R,
+        GL_CLAMP_TO_EDGE);
+
+    for (i = 0; i < 6; ++i)
+    {
+        glTexImage2D(faces[i].target, 0, GL_RGBA8, env->size, env->size,
+            0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+
+    glGenRenderbuffers(1, &(env->depthRenderbufferId));
+    glBindRenderbuffer(GL_RENDERBUFFER, env->depthRenderbufferId);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24,
+        env->size, env->size);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &(env->fboId));
+    glBindFramebuffer(GL_FRAMEBUFFER, env->fboId);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+        GL_RENDERBUFFER, env->depthRenderbufferId);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    env->stale = GL_TRUE;
+    env->rays = WATER_RAYS_TRACE;
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+
+    return env;
+}
+
+void setupWaterEnv(ShaderProgram * sp, const WaterEnv * env)
+{
+    GLint obj;
+
+    glUseProgram(sp->p);
+
+    obj = glGetUniformLocation(sp->p, "texEnv");
+    /* TODO: if (obj == -1) {} */
+    glUniform1i(obj, WATER_ENV_UNIT);
+
+    obj = glGetUniformLocation(sp->p, "envPos");
+    /* TODO: if (obj == -1) {} */
+    glUniform3fv(obj, 1, env->pos);
+
+    obj = glGetUniformLocation(sp->p, "envBoxMin");
+    /* TODO: if (obj == -1) {} */
+    glUniform3fv(obj, 1, env->boxMin);
+
+    obj = glGetUniformLocation(sp->p, "envBoxMax");
+    /* TODO: if (obj == -1) {} */
+    glUniform3fv(obj, 1, env->boxMax);
+
+    obj = glGetUniformLocation(sp->p, "rays");
+    /* TODO: if (obj == -1) {} */
+    glUniform1i(obj, env->rays);
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+}
+
+void updateWaterEnv(WaterEnv * env, World * world, const Camera * camera)
+{
+    GLint viewport[4];
+    mat4 viewProj;
+    int i;
+
+    if (!env->stale)
+    {
+        return;
+    }
+
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, env->fboId);
+    glViewport(0, 0, env->size, env->size);
+
+    for (i = 0; i < 6; ++i)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+            faces[i].target, env->cubeTextureId, 0);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+            GL_FRAMEBUFFER_COMPLETE)
+        {
+            fprintf(stderr, "Incomplete framebuffer of cube map.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        /* Clear color is color of far water. */
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        setFaceMatrix(viewProj, faces + i, env->pos);
+        setupTransform(camera, TRANSFORM_VIEW_ENV + i, viewProj, env->pos);
+
+        drawWorld(world);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    useCameraTransform(camera);
+
+    env->stale = GL_FALSE;
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+}
+
+void setWaterEnvRays(ShaderProgram * sp, WaterEnv * env, WaterRays rays)
+{
+    env->rays = rays;
+
+    setupWaterEnv(sp, env);
+}
+
+const char * getWaterRaysName(WaterRays rays)
+{
+    return raysNames[rays];
+}
+
+void freeWaterEnv(WaterEnv * env)
+{
+    glDeleteFramebuffers(1, &(env->fboId));
+    glDeleteRenderbuffers(1, &(env->depthRenderbufferId));
+    glDeleteTextures(1, &(env->cubeTextureId));
+
+    free(env);
+}
@@ -0,0 +1,66 @@
+#ifndef WATER_ENV_H_SENTRY
+#define WATER_ENV_H_SENTRY
+
+#include "world.h"
+#include "water.h"
+#include "camera.h"
+
+/* Cube map of the world captured high above the pool centre, water rays
+ * can look up their color in it instead of tracing world proxy (see
+ * calcRayColor() in draw_water_fshader.glsl). World and light are
+ * static, so the world is captured only when the map is stale. */
+
+/* Source of color of reflected and refracted rays. */
+typedef
+enum WaterRays
+{
+    /* Nearest triangle of world proxy. */
+    WATER_RAYS_TRACE,
+    /* Cube map in direction of ray. */
+    WATER_RAYS_ENV,
+    /* Cube map towards point where ray leaves pool box. */
+    WATER_RAYS_ENV_PARALLAX,
+    WATER_RAYS_CNT
+}
+WaterRays;
+
+typedef
+struct WaterEnv
+{
+    /* Point of capture. */
+    vec3 pos;
+
+    /* Pool box for parallax correction: water area from the lowest to
+     * the highest world triangle inside it. Its top is open, ray which
+     * leaves through it goes to far world. */
+    vec3 boxMin;
+    vec3 boxMax;
+
+    int size;
+    GLuint cubeTextureId;
+    GLuint depthRenderbufferId;
+    GLuint fboId;
+
+    /* World is not captured yet or changed since capture. */
+    GLboolean stale;
+
+    WaterRays rays;
+}
+WaterEnv;
+
+WaterEnv * newWaterEnv(const World * world, const Water * water);
+
+/* Binds cube map and sets uniforms of sp. */
+void setupWaterEnv(ShaderProgram * sp, const WaterEnv * env);
+
+/* Captures the world if the map is stale. Transform block is bound
+ * back to camera. */
+void updateWaterEnv(WaterEnv * env, World * world, const Camera * camera);
+
+void setWaterEnvRays(ShaderProgram * sp, WaterEnv * env, WaterRays rays);
+
+const char * getWaterRaysName(WaterRays rays);
+
+void freeWaterEnv(WaterEnv * env);
+
+#endif /* WATER_ENV_H_SENTRY */
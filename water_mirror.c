@@ -0,0 +1,234 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "water_mirror.h"
+#include "texture.h"
+#include "shaders_errors.h"
+
+/* Reflection texture is bound to this unit for all time. */
+#define WATER_MIRROR_UNIT 16
+
+static float sign(float f)
+{
+    return (f > 0.0f) ? 1.0f : ((f < 0.0f) ? -1.0f : 0.0f);
+}
+
+/* Replaces near plane of perspective projection m with plane c (in view
+ * space, camera is on its negative side), see LINKS: [11]. */
+static void setObliqueNearPlane(mat4 m, const vec4 c)
+{
+    vec4 q;
+    float scale;
+
+    q[0] = (sign(c[0]) + m[2]) / m[0];
+    q[1] = (sign(c[1]) + m[6]) / m[5];
+    q[2] = -1.0f;
+    q[3] = (1.0f + m[10]) / m[11];
+
+    scale = 2.0f / (c[0] * q[0] + c[1] * q[1] + c[2] * q[2] + c[3] * q[3]);
+
+    m[8] = c[0] * scale;
+    m[9] = c[1] * scale;
+    m[10] = c[2] * scale + 1.0f;
+    m[11] = c[3] * scale;
+}
+
+static void genBuffer(WaterMirror * mirror, int w, int h)
+{
+    mirror->w = w;
+    mirror->h = h;
+
+    mirror->colorTextureId = createTexture(w, h, GL_RGBA8, NULL);
+
+    glGenRenderbuffers(1, &(mirror->depthRenderbufferId));
+    glBindRenderbuffer(GL_RENDERBUFFER, mirror->depthRenderbufferId);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &(mirror->fboId));
+    glBindFramebuffer(GL_FRAMEBUFFER, mirror->fboId);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_TEXTURE_2D, mirror->colorTextureId, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+        GL_RENDERBUFFER, mirror->depthRenderbufferId);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fprintf(stderr, "Incomplete framebuffer of planar reflection.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glActiveTexture(GL_TEXTURE0 + WATER_MIRROR_UNIT);
+    glBindTexture(GL_TEXTURE_2D, mirror->colorTextureId);
+    glActiveTexture(GL_TEXTURE0);
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+}
+
+static void freeBuffer(WaterMirror * mirror)
+{
+    if (mirror->w == 0)
+    {
+        return;
+    }
+
+    glDeleteFramebuffers(1, &(mirror->fboId));
+    glDeleteRenderbuffers(1, &(mirror->depthRenderbufferId));
+    glDeleteTextures(1, &(mirror->colorTextureId));
+
+    mirror->w = 0;
+    mirror->h = 0;
+}
+
+WaterMirror * newWaterMirror(const World * world)
+{
+    WaterMirror * mirror = (WaterMirror *) malloc(sizeof(WaterMirror));
+
+    mirror->scale = 0;
+    mirror->w = 0;
+    mirror->h = 0;
+
+    mirror->mirroredLoc = glGetUniformLocation(world->sp->p, "mirrored");
+    /* TODO: if (mirror->mirroredLoc == -1) {} */
+
+    glGenQueries(2, mirror->drawQueryIds);
+    mirror->drawQueryCnt = 0;
+    mirror->drawSeconds = 0.0f;
+
+    return mirror;
+}
+
+void setupWaterMirror(ShaderProgram * sp, const WaterMirror * mirror)
+{
+    GLint obj;
+
+    glUseProgram(sp->p);
+
+    obj = glGetUniformLocation(sp->p, "texMirror");
+    /* TODO: if (obj == -1) {} */
+    glUniform1i(obj, WATER_MIRROR_UNIT);
+
+    obj = glGetUniformLocation(sp->p, "mirror");
+    /* TODO: if (obj == -1) {} */
+    glUniform1i(obj, mirror->scale > 0);
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+}
+
+void updateWaterMirror(WaterMirror * mirror, World * world,
+    const Water * water, const Camera * camera)
+{
+    float z = water->data->z;
+    float side = (camera->pos[2] >= z) ? 1.0f : -1.0f;
+    GLint viewport[4];
+    mat4 view, proj, reflection, mirrorView, viewProj;
+    vec3 pos;
+    vec4 plane;
+    int w, h, k;
+    GLuint queryId;
+
+    if (mirror->scale == 0)
+    {
+        mirror->drawSeconds = 0.0f;
+        return;
+    }
+
+    queryId = mirror->drawQueryIds[mirror->drawQueryCnt % 2];
+
+    if (mirror->drawQueryCnt >= 2)
+    {
+        GLuint64 ns;
+
+        glGetQueryObjectui64v(queryId, GL_QUERY_RESULT, &ns);
+        mirror->drawSeconds = ns / 1e9f;
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, queryId);
+
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    w = (viewport[2] + mirror->scale - 1) / mirror->scale;
+    h = (viewport[3] + mirror->scale - 1) / mirror->scale;
+
+    if (w != mirror->w || h != mirror->h)
+    {
+        freeBuffer(mirror);
+        genBuffer(mirror, w, h);
+    }
+
+    /* z' = 2 * z - z. */
+    setTranslationMatrix(reflection, 0.0f, 0.0f, 2.0f * z);
+    reflection[10] = -1.0f;
+
+    setCameraViewMatrix(view, camera);
+    setMulMatrix(mirrorView, view, reflection);
+
+    /* Water plane in view space, its normal looks to the camera side,
+     * so the mirrored camera is on its negative side. */
+    for (k = 0; k < 3; ++k)
+    {
+        plane[k] = mirrorView[4 * k + 2] * side;
+    }
+
+    plane[3] = 0.0f;
+
+    for (k = 0; k < 3; ++k)
+    {
+        plane[3] -= plane[k] * (mirrorView[4 * k + 2] * z +
+            mirrorView[4 * k + 3]);
+    }
+
+    setCameraProjMatrix(proj, camera);
+    setObliqueNearPlane(proj, plane);
+    setMulMatrix(viewProj, proj, mirrorView);
+
+    pos[0] = camera->pos[0];
+    pos[1] = camera->pos[1];
+    pos[2] = 2.0f * z - camera->pos[2];
+
+    glBindFramebuffer(GL_FRAMEBUFFER, mirror->fboId);
+    glViewport(0, 0, w, h);
+
+    /* Clear color is color of far water. */
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    setupTransform(camera, TRANSFORM_VIEW_MIRROR, viewProj, pos);
+    glUseProgram(world->sp->p);
+    glUniform1i(mirror->mirroredLoc, 1);
+
+    drawWorld(world);
+
+    glUniform1i(mirror->mirroredLoc, 0);
+    useCameraTransform(camera);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    glEndQuery(GL_TIME_ELAPSED);
+    ++(mirror->drawQueryCnt);
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+}
+
+void setWaterMirrorScale(ShaderProgram * sp, WaterMirror * mirror,
+    int scale)
+{
+    mirror->scale = scale;
+
+    if (scale == 0)
+    {
+        freeBuffer(mirror);
+    }
+
+    setupWaterMirror(sp, mirror);
+}
+
+void freeWaterMirror(WaterMirror * mirror)
+{
+    freeBuffer(mirror);
+    glDeleteQueries(2, mirror->drawQueryIds);
+
+    free(mirror);
+}
@@ -0,0 +1,54 @@
+#ifndef WATER_MIRROR_H_SENTRY
+#define WATER_MIRROR_H_SENTRY
+
+#include "world.h"
+#include "water.h"
+#include "camera.h"
+
+/* Planar reflection: the world is rendered each frame by the camera
+ * mirrored about rest plane of water into reflection texture, water
+ * samples it instead of casting reflected rays. Only the world on the
+ * side of the camera is rendered (oblique near plane), cost depends on
+ * size of the texture, not on the world. */
+
+typedef
+struct WaterMirror
+{
+    /* Texture is viewport size / scale, 0 -- no planar reflection. */
+    int scale;
+
+    /* Size of texture, 0 -- not created yet. */
+    int w;
+    int h;
+
+    GLuint fboId;
+    GLuint colorTextureId;
+    GLuint depthRenderbufferId;
+
+    /* Uniform location in world->sp. */
+    GLint mirroredLoc;
+
+    /* GPU time of updateWaterMirror(), 0 if planar reflection is off.
+     * Two timer queries are used in turn, as in Water. */
+    GLuint drawQueryIds[2];
+    int drawQueryCnt;
+    float drawSeconds;
+}
+WaterMirror;
+
+WaterMirror * newWaterMirror(const World * world);
+
+/* Binds reflection texture and sets uniforms of sp. */
+void setupWaterMirror(ShaderProgram * sp, const WaterMirror * mirror);
+
+/* Renders reflection texture, if planar reflection is on. Transform
+ * block is bound back to camera. */
+void updateWaterMirror(WaterMirror * mirror, World * world,
+    const Water * water, const Camera * camera);
+
+void setWaterMirrorScale(ShaderProgram * sp, WaterMirror * mirror,
+    int scale);
+
+void freeWaterMirror(WaterMirror * mirror);
+
+#endif /* WATER_MIRROR_H_SENTRY */
@@ -0,0 +1,448 @@
+#include <stdlib.h>
+#include <math.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#include "water_solver.h"
+
+/* Same constants as in modify_water_fshader.glsl. */
+#define SOLVER_W 1.950f
+#define SOLVER_PI 3.14159265358979323846f
+#define SOLVER_WAVE_C 0.3600349828087051f
+
+/* Row band is a task for thread pool. Some bands for each thread, so
+ * there is something to steal when threads are uneven. */
+#define SOLVER_BAND_ROWS_MIN 16
+#define SOLVER_BANDS_PER_THREAD 4
+
+/* Temporal blocking: count of steps in one block and width of column
+ * strip. Few rows of strip for each step of block fit in L2 cache. */
+#define SOLVER_BLOCK_STEPS_DEFAULT 8
+#define SOLVER_BLOCK_COLS_DEFAULT 256
+
+/* With thread pool strips are narrowed down to this width, so each
+ * thread has a strip, and each strip is splitted into tasks of this
+ * count of skewed rows. */
+#define SOLVER_STRIP_COLS_MIN 32
+#define SOLVER_STRIP_TASK_ROWS 32
+
+static const int nxt[] = {1, 2, 0};
+
+WaterSolver * newWaterSolver(int w, int h, float z)
+{
+    WaterSolver * solver = (WaterSolver *) malloc(sizeof(WaterSolver));
+    int i, j;
+
+    solver->w = w;
+    solver->h = h;
+
+    for (i = 0; i < 3; ++i)
+    {
+        solver->heights[i] = (float *) malloc(w * h * sizeof(float));
+
+        for (j = 0; j < w * h; ++j)
+        {
+            solver->heights[i][j] = z;
+        }
+    }
+
+    solver->firstHeights = 2;
+    solver->pool = NULL;
+    solver->kernel = WATER_SOLVER_NAIVE;
+    solver->blockSteps = SOLVER_BLOCK_STEPS_DEFAULT;
+    solver->blockCols = SOLVER_BLOCK_COLS_DEFAULT;
+    solver->makeWave = 0;
+    solver->bytesMoved = 0.0;
+
+    return solver;
+}
+
+/* dst = (1 - w) * fst + w * (sndL + sndR + sndD + sndU) / 4 for columns
+ * [x0; x1), neighbours out of field are clamped to edge
+ * (as GL_CLAMP_TO_EDGE). */
+static void stepRowPart(float * dst, const float * fst, const float * sndD,
+    const float * snd, const float * sndU, int w, int x0, int x1)
+{
+    const float a = 1.0f - SOLVER_W;
+    const float b = SOLVER_W * 0.25f;
+    int x = x0;
+    int xEnd = (x1 < w - 1) ? x1 : w - 1;
+
+    if (x == 0 && x < x1)
+    {
+        dst[0] = a * fst[0] +
+            b * ((snd[0] + snd[w > 1 ? 1 : 0]) + (sndD[0] + sndU[0]));
+        ++x;
+    }
+
+#ifdef __SSE__
+    {
+        __m128 va = _mm_set1_ps(a);
+        __m128 vb = _mm_set1_ps(b);
+
+        for (; x + 4 <= xEnd; x += 4)
+        {
+            __m128 lr = _mm_add_ps(_mm_loadu_ps(snd + x - 1),
+                _mm_loadu_ps(snd + x + 1));
+            __m128 du = _mm_add_ps(_mm_loadu_ps(sndD + x),
+                _mm_loadu_ps(sndU + x));
+
+            _mm_storeu_ps(dst + x,
+                _mm_add_ps(_mm_mul_ps(va, _mm_loadu_ps(fst + x)),
+                    _mm_mul_ps(vb, _mm_add_ps(lr, du))));
+        }
+    }
+#endif
+
+    for (; x < xEnd; ++x)
+    {
+        dst[x] = a * fst[x] +
+            b * ((snd[x - 1] + snd[x + 1]) + (sndD[x] + sndU[x]));
+    }
+
+    if (x == w - 1 && x < x1 && w > 1)
+    {
+        dst[x] = a * fst[x] +
+            b * ((snd[x - 1] + snd[x]) + (sndD[x] + sndU[x]));
+    }
+}
+
+static void stepRow(float * dst, const float * fst, const float * sndD,
+    const float * snd, const float * sndU, int w)
+{
+    stepRowPart(dst, fst, sndD, snd, sndU, w, 0, w);
+}
+
+static void makeWave(WaterSolver * solver, float * dst)
+{
+    int w = solver->w;
+    int h = solver->h;
+    float r = solver->waveRadius;
+
+    /* Only texels in bounding box of the wave. */
+    int x0 = (int) floor((solver->waveX - r) * w);
+    int x1 = (int) ceil((solver->waveX + r) * w);
+    int y0 = (int) floor((solver->waveY - r) * h);
+    int y1 = (int) ceil((solver->waveY + r) * h);
+    int x, y;
+
+    x0 = (x0 < 0) ? 0 : x0;
+    y0 = (y0 < 0) ? 0 : y0;
+    x1 = (x1 > w - 1) ? w - 1 : x1;
+    y1 = (y1 > h - 1) ? h - 1 : y1;
+
+    for (y = y0; y <= y1; ++y)
+    {
+        for (x = x0; x <= x1; ++x)
+        {
+            float dx = (x + 0.5f) / w - solver->waveX;
+            float dy = (y + 0.5f) / h - solver->waveY;
+            float dist = (float) sqrt(dx * dx + dy * dy);
+
+            if (dist <= r)
+            {
+                dist = dist / r * (SOLVER_PI / 2.0f);
+                dst[y * w + x] -= solver->waveHeight *
+                    ((float) cos(dist) - SOLVER_WAVE_C);
+            }
+        }
+    }
+}
+
+/* Rows [y0; y1). */
+static void stepRows(float * dst, const float * fst, const float * snd,
+    int w, int h, int y0, int y1)
+{
+    int y;
+
+    for (y = y0; y < y1; ++y)
+    {
+        const float * sndD = snd + ((y > 0) ? y - 1 : 0) * w;
+        const float * sndU = snd + ((y < h - 1) ? y + 1 : h - 1) * w;
+
+        stepRow(dst + y * w, fst + y * w, sndD, snd + y * w, sndU, w);
+    }
+}
+
+typedef
+struct SolverBands
+{
+    float * dst;
+    const float * fst;
+    const float * snd;
+    int w;
+    int h;
+    int bandRows;
+}
+SolverBands;
+
+/* Bands only read snd rows of neighbour bands and it is not changed
+ * during step, so boundary rows need not be copied. */
+static void stepBand(void * arg, int taskIdx)
+{
+    SolverBands * bands = (SolverBands *) arg;
+    int y0 = taskIdx * bands->bandRows;
+    int y1 = y0 + bands->bandRows;
+
+    stepRows(bands->dst, bands->fst, bands->snd, bands->w, bands->h,
+        y0, (y1 < bands->h) ? y1 : bands->h);
+}
+
+void setWaterSolverThreads(WaterSolver * solver, int threadCnt)
+{
+    if (solver->pool != NULL)
+    {
+        freeThreadPool(solver->pool);
+        solver->pool = NULL;
+    }
+
+    if (threadCnt != 1)
+    {
+        solver->pool = newThreadPool(threadCnt);
+    }
+}
+
+void stepWaterSolver(WaterSolver * solver)
+{
+    int w = solver->w;
+    int h = solver->h;
+
+    const float * fst;
+    const float * snd;
+    float * dst;
+
+    solver->firstHeights = nxt[solver->firstHeights];
+
+    fst = solver->heights[solver->firstHeights];
+    snd = solver->heights[nxt[solver->firstHeights]];
+    dst = solver->heights[nxt[nxt[solver->firstHeights]]];
+
+    if (solver->pool == NULL)
+    {
+        stepRows(dst, fst, snd, w, h, 0, h);
+    }
+    else
+    {
+        SolverBands bands;
+
+        bands.dst = dst;
+        bands.fst = fst;
+        bands.snd = snd;
+        bands.w = w;
+        bands.h = h;
+        bands.bandRows = h / (solver->pool->threadCnt *
+            SOLVER_BANDS_PER_THREAD);
+
+        if (bands.bandRows < SOLVER_BAND_ROWS_MIN)
+        {
+            bands.bandRows = SOLVER_BAND_ROWS_MIN;
+        }
+
+        runThreadPool(solver->pool, stepBand, &bands,
+            (h + bands.bandRows - 1) / bands.bandRows);
+    }
+
+    if (solver->makeWave)
+    {
+        makeWave(solver, dst);
+        solver->makeWave = 0;
+    }
+}
+
+typedef
+struct SolverStrips
+{
+    WaterSolver * solver;
+    int stepCnt;
+    int cols;
+    int stripCnt;
+    int taskCnt;
+
+    /* Tasks of current run: strip firstStrip + taskIdx, its part
+     * diagonal - strip. */
+    int diagonal;
+    int firstStrip;
+}
+SolverStrips;
+
+/* Skewed rows [y0; y1) of strip starting at column x0, see
+ * stepWaterSolverBlock(). Step k writes to heights[(base + k + 1) % 3],
+ * steps 0 and -1 are already done. */
+static void stepStripRows(WaterSolver * solver, int stepCnt, int x0,
+    int cols, int y0, int y1)
+{
+    int w = solver->w;
+    int h = solver->h;
+    int base = nxt[solver->firstHeights];
+    int x1 = (x0 + cols < w) ? x0 + cols : w + stepCnt - 1;
+    int y, k;
+
+    for (y = y0; y < y1; ++y)
+    {
+        for (k = 1; k <= stepCnt; ++k)
+        {
+            int r = y - (k - 1);
+            int c0 = x0 - (k - 1);
+            int c1 = x1 - (k - 1);
+
+            float * dst = solver->heights[(base + k + 1) % 3];
+            const float * snd = solver->heights[(base + k) % 3];
+            const float * fst = solver->heights[(base + k - 1) % 3];
+
+            if (r < 0 || r >= h)
+            {
+                continue;
+            }
+
+            c0 = (c0 > 0) ? c0 : 0;
+            c1 = (c1 < w) ? c1 : w;
+
+            if (c0 >= c1)
+            {
+                continue;
+            }
+
+            stepRowPart(dst + r * w, fst + r * w,
+                snd + ((r > 0) ? r - 1 : 0) * w, snd + r * w,
+                snd + ((r < h - 1) ? r + 1 : h - 1) * w,
+                w, c0, c1);
+        }
+    }
+}
+
+static void stepStripTask(void * arg, int taskIdx)
+{
+    SolverStrips * strips = (SolverStrips *) arg;
+    int strip = strips->firstStrip + taskIdx;
+    int y0 = (strips->diagonal - strip) * SOLVER_STRIP_TASK_ROWS;
+    int y1 = y0 + SOLVER_STRIP_TASK_ROWS;
+    int yEnd = strips->solver->h + strips->stepCnt - 1;
+
+    stepStripRows(strips->solver, strips->stepCnt, strip * strips->cols,
+        strips->cols, y0, (y1 < yEnd) ? y1 : yEnd);
+}
+
+/* Makes stepCnt steps at once. Step k of block is row band skewed
+ * by k - 1 rows back and k - 1 columns left relative to step 1, so
+ * all values which step k needs are computed before in the same strip
+ * or in the previous strip. Step k overwrites step k - 3 only where
+ * nobody needs it anymore, so three buffers are enough. Each strip
+ * goes through memory once per block instead of once per step.
+ *
+ * Strip reads only itself and the previous strip, which overwrites
+ * nothing the strip still needs. So with thread pool part p of strip s
+ * (SOLVER_STRIP_TASK_ROWS skewed rows) needs only parts p of strip
+ * s - 1 and p - 1 of strip s: parts of one diagonal s + p run in
+ * parallel, diagonals one by one (wavefront). */
+static void stepWaterSolverBlock(WaterSolver * solver, int stepCnt)
+{
+    int w = solver->w;
+    int cols = solver->blockCols;
+    int yEnd = solver->h + stepCnt - 1;
+    SolverStrips strips;
+    int x0;
+
+    if (solver->pool == NULL)
+    {
+        for (x0 = 0; x0 < w; x0 += cols)
+        {
+            stepStripRows(solver, stepCnt, x0, cols, 0, yEnd);
+        }
+
+        solver->firstHeights = (solver->firstHeights + stepCnt) % 3;
+        return;
+    }
+
+    if (cols * solver->pool->threadCnt > w)
+    {
+        cols = (w + solver->pool->threadCnt - 1) / solver->pool->threadCnt;
+        cols = (cols > SOLVER_STRIP_COLS_MIN) ? cols : SOLVER_STRIP_COLS_MIN;
+    }
+
+    strips.solver = solver;
+    strips.stepCnt = stepCnt;
+    strips.cols = cols;
+    strips.stripCnt = (w + cols - 1) / cols;
+    strips.taskCnt = (yEnd + SOLVER_STRIP_TASK_ROWS - 1) /
+        SOLVER_STRIP_TASK_ROWS;
+
+    for (strips.diagonal = 0;
+        strips.diagonal < strips.stripCnt + strips.taskCnt - 1;
+        ++(strips.diagonal))
+    {
+        int last = (strips.diagonal < strips.stripCnt) ?
+            strips.diagonal : strips.stripCnt - 1;
+
+        strips.firstStrip = (strips.diagonal < strips.taskCnt) ?
+            0 : strips.diagonal - strips.taskCnt + 1;
+
+        runThreadPool(solver->pool, stepStripTask, &strips,
+            last - strips.firstStrip + 1);
+    }
+
+    solver->firstHeights = (solver->firstHeights + stepCnt) % 3;
+}
+
+void setWaterSolverKernel(WaterSolver * solver, WaterSolverKernel kernel)
+{
+    solver->kernel = kernel;
+}
+
+void runWaterSolver(WaterSolver * solver, int stepCnt)
+{
+    while (stepCnt > 0)
+    {
+        int blockSteps = (stepCnt < solver->blockSteps) ?
+            stepCnt : solver->blockSteps;
+
+        /* Wave is made by single step, as in naive kernel. */
+        if (solver->kernel == WATER_SOLVER_NAIVE || solver->makeWave ||
+            blockSteps < 2)
+        {
+            stepWaterSolver(solver);
+            --stepCnt;
+
+            /* fst and snd are read, dst is written. */
+            solver->bytesMoved += 3.0 * solver->w * solver->h *
+                sizeof(float);
+        }
+        else
+        {
+            stepWaterSolverBlock(solver, blockSteps);
+            stepCnt -= blockSteps;
+
+            /* Steps -1 and 0 are read, each buffer is written once with
+             * its last step. */
+            solver->bytesMoved += (2.0 + ((blockSteps < 3) ? blockSteps : 3))
+                * solver->w * solver->h * sizeof(float);
+        }
+    }
+}
+
+void setWaterSolverWave(WaterSolver * solver, float x, float y,
+    float radius, float height)
+{
+    solver->makeWave = 1;
+    solver->waveX = x;
+    solver->waveY = y;
+    solver->waveRadius = radius;
+    solver->waveHeight = height;
+}
+
+const float * getWaterSolverHeights(const WaterSolver * solver)
+{
+    return solver->heights[nxt[nxt[solver->firstHeights]]];
+}
+
+void freeWaterSolver(WaterSolver * solver)
+{
+    if (solver->pool != NULL)
+    {
+        freeThreadPool(solver->pool);
+    }
+
+    free(solver->heights[0]);
+    free(solver->heights[1]);
+    free(solver->heights[2]);
+    free(solver);
+}
@@ -0,0 +1,79 @@
+#ifndef WATER_SOLVER_H_SENTRY
+#define WATER_SOLVER_H_SENTRY
+
+#include "thread_pool.h"
+
+/* CPU version of modify_water_fshader.glsl. It does not use OpenGL,
+ * so it can be linked into headless tools. */
+
+typedef
+enum WaterSolverKernel
+{
+    /* One pass over field for each step. */
+    WATER_SOLVER_NAIVE,
+    /* Some steps per pass over field (see stepWaterSolverBlock()),
+     * strips run as wavefront on thread pool. */
+    WATER_SOLVER_TEMPORAL
+}
+WaterSolverKernel;
+
+typedef
+struct WaterSolver
+{
+    /* Count of height values in horizontal/vertical line. */
+    int w;
+    int h;
+
+    /* Three rotating height buffers (w * h values each), like
+     * Water->textureIds. */
+    int firstHeights;
+    float * heights[3];
+
+    /* Naive step is splitted into row bands, temporal block into
+     * strips, NULL -- single thread. */
+    ThreadPool * pool;
+
+    /* Kernel for runWaterSolver(). */
+    WaterSolverKernel kernel;
+    int blockSteps;
+    int blockCols;
+
+    /* Wave for next step, like impulse of Water (see addWaterImpulse()). */
+    int makeWave;
+    float waveX;
+    float waveY;
+    float waveRadius;
+    float waveHeight;
+
+    /* Memory traffic of runWaterSolver() steps, estimated as each buffer
+     * going through memory once per pass over field. */
+    double bytesMoved;
+}
+WaterSolver;
+
+WaterSolver * newWaterSolver(int w, int h, float z);
+
+/* threadCnt: 1 -- single thread (default), <= 0 -- thread for each
+ * processor. */
+void setWaterSolverThreads(WaterSolver * solver, int threadCnt);
+
+void setWaterSolverKernel(WaterSolver * solver, WaterSolverKernel kernel);
+
+/* One step by naive kernel. */
+void stepWaterSolver(WaterSolver * solver);
+
+/* stepCnt steps by selected kernel. */
+void runWaterSolver(WaterSolver * solver, int stepCnt);
+
+/* x, y, radius -- in texture coordinates ([0; 1]), height -- full height
+ * from down to up wave. The GPU version uses radius = 0.0635 and
+ * height = 0.4. */
+void setWaterSolverWave(WaterSolver * solver, float x, float y,
+    float radius, float height);
+
+/* Heights after last step, w * h values, row by row. */
+const float * getWaterSolverHeights(const WaterSolver * solver);
+
+void freeWaterSolver(WaterSolver * solver);
+
+#endif /* WATER_SOLVER_H_SENTRY */
@@ -0,0 +1,477 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <sys/time.h>
+#include "wave_tool.h"
+#include "water_solver.h"
+#include "world_parser.h"
+#include "world_binary.h"
+#include "world_lexer.h"
+#include "float_scan.h"
+#include "utils.h"
+#include "thread_pool.h"
+
+/* Headless tool, works without OpenGL context. */
+
+#define SOLVER_W_DEFAULT 1024
+#define SOLVER_H_DEFAULT 1024
+#define SOLVER_STEPS_DEFAULT 1000
+
+#define WORLD_PATH_DEFAULT "world.txt"
+#define WORLD_REPEATS_DEFAULT 10
+
+void usage(const char * name)
+{
+    fprintf(stderr,
+        "Usage: %s solver [w h steps [threads [naive|temporal]]]\n"
+        "       %s precision [w h steps]\n"
+        "       %s world [path [repeats [threads]]]\n"
+        "       %s floats [path [repeats]]\n"
+        "       %s compile [path]\n", name, name, name, name, name);
+    exit(EXIT_FAILURE);
+}
+
+/* Runs solver with one wave in center, prints speed and checksum. */
+int runSolver(int argc, char ** argv)
+{
+    int w = (argc > 2) ? atoi(argv[2]) : SOLVER_W_DEFAULT;
+    int h = (argc > 3) ? atoi(argv[3]) : SOLVER_H_DEFAULT;
+    int steps = (argc > 4) ? atoi(argv[4]) : SOLVER_STEPS_DEFAULT;
+    int threadCnt = (argc > 5) ? atoi(argv[5]) : 1;
+    const char * kernel = (argc > 6) ? argv[6] : "naive";
+
+    WaterSolver * solver;
+    struct timeval startTime;
+    const float * heights;
+    double sum = 0.0;
+    float seconds;
+    int i;
+
+    if (w < 2 || h < 2 || steps < 1)
+    {
+        usage(argv[0]);
+    }
+
+    solver = newWaterSolver(w, h, 0.5f);
+    setWaterSolverThreads(solver, threadCnt);
+
+    if (STR_EQUAL(kernel, "temporal"))
+    {
+        setWaterSolverKernel(solver, WATER_SOLVER_TEMPORAL);
+    }
+    else if (! STR_EQUAL(kernel, "naive"))
+    {
+        usage(argv[0]);
+    }
+    setWaterSolverWave(solver, 0.5f, 0.5f,
+        2.0f * (1.0f / (w - 1) + 1.0f / (h - 1)), 0.4f);
+
+    timeval_diff_replace(&startTime);
+
+    runWaterSolver(solver, steps);
+
+    seconds = timeval_diff_replace(&startTime);
+
+    heights = getWaterSolverHeights(solver);
+
+    for (i = 0; i < w * h; ++i)
+    {
+        sum += heights[i];
+    }
+
+    printf("solver: %dx%d, %d steps, %d threads, %s, %.3f s, "
+        "%.1f steps/s, %.1f Mtexel/s, %.2f MB/step, %.2f GB/s, "
+        "checksum %.6f\n",
+        w, h, steps, (solver->pool != NULL) ? solver->pool->threadCnt : 1,
+        kernel,
+        seconds, steps / seconds,
+        (double) w * h * steps / seconds / 1e6,
+        solver->bytesMoved / steps / 1e6,
+        solver->bytesMoved / seconds / 1e9, sum);
+
+    freeWaterSolver(solver);
+
+    return EXIT_SUCCESS;
+}
+
+/* Nearest value which can be stored in half precision float (as in
+ * R16F texture), ties are rounded up. */
+static float roundHalf(float f)
+{
+    union
+    {
+        float f;
+        unsigned int u;
+    }
+    v;
+
+    /* Subnormal half: step is 2^-24. */
+    if (fabs(f) < 6.103515625e-05f)
+    {
+        return (float) (floor(f * 16777216.0 + 0.5) / 16777216.0);
+    }
+
+    /* Normal half: 10 of 23 mantissa bits. */
+    v.f = f;
+    v.u = (v.u + 0x1000u) & ~0x1fffu;
+
+    return v.f;
+}
+
+typedef
+enum StorageFormat
+{
+    STORAGE_R32F,
+    STORAGE_R16F,
+    STORAGE_RG32F,
+    STORAGE_RG16F,
+    STORAGE_FORMATS_CNT
+}
+StorageFormat;
+
+static const char * storageFormatStr[] =
+{
+    "R32F",
+    "R16F",
+    "RG32F",
+    "RG16F"
+};
+
+/* Makes step as GPU does with given heights texture format: dst is
+ * stored with texture precision, RG formats also store velocity
+ * dst - snd and next step takes fst as height - velocity. */
+static void stepStorage(WaterSolver * solver, StorageFormat format)
+{
+    float * snd;
+    float * dst;
+    int i;
+
+    stepWaterSolver(solver);
+
+    snd = solver->heights[(solver->firstHeights + 1) % 3];
+    dst = solver->heights[(solver->firstHeights + 2) % 3];
+
+    for (i = 0; i < solver->w * solver->h; ++i)
+    {
+        float v = dst[i] - snd[i];
+
+        switch (format)
+        {
+            case STORAGE_R32F:
+            case STORAGE_FORMATS_CNT:
+                break;
+            case STORAGE_R16F:
+                dst[i] = roundHalf(dst[i]);
+                break;
+            case STORAGE_RG32F:
+                snd[i] = dst[i] - v;
+                break;
+            case STORAGE_RG16F:
+                dst[i] = roundHalf(dst[i]);
+                snd[i] = dst[i] - roundHalf(v);
+                break;
+        }
+    }
+}
+
+/* Compares heights after the same steps with each heights texture
+ * format against float heights without packing. Heights are relative
+ * to rest level, as in textures. */
+int runPrecision(int argc, char ** argv)
+{
+    int w = (argc > 2) ? atoi(argv[2]) : SOLVER_W_DEFAULT;
+    int h = (argc > 3) ? atoi(argv[3]) : SOLVER_H_DEFAULT;
+    int steps = (argc > 4) ? atoi(argv[4]) : SOLVER_STEPS_DEFAULT;
+
+    WaterSolver * solvers[STORAGE_FORMATS_CNT];
+    const float * ref;
+    float amplitude = 0.0f;
+    int i, j, k;
+
+    if (w < 2 || h < 2 || steps < 1)
+    {
+        usage(argv[0]);
+    }
+
+    for (i = 0; i < STORAGE_FORMATS_CNT; ++i)
+    {
+        solvers[i] = newWaterSolver(w, h, 0.0f);
+        setWaterSolverWave(solvers[i], 0.5f, 0.5f,
+            2.0f * (1.0f / (w - 1) + 1.0f / (h - 1)), 0.4f);
+
+        for (k = 0; k < steps; ++k)
+        {
+            stepStorage(solvers[i], (StorageFormat) i);
+        }
+    }
+
+    ref = getWaterSolverHeights(solvers[STORAGE_R32F]);
+
+    for (j = 0; j < w * h; ++j)
+    {
+        float d = (float) fabs(ref[j]);
+        amplitude = (d > amplitude) ? d : amplitude;
+    }
+
+    printf("precision: %dx%d, %d steps, max |height| %.6f\n",
+        w, h, steps, amplitude);
+
+    for (i = 0; i < STORAGE_FORMATS_CNT; ++i)
+    {
+        const float * heights = getWaterSolverHeights(solvers[i]);
+        double maxError = 0.0;
+        double sqSum = 0.0;
+
+        for (j = 0; j < w * h; ++j)
+        {
+            double d = fabs(heights[j] - ref[j]);
+            maxError = (d > maxError) ? d : maxError;
+            sqSum += d * d;
+        }
+
+        printf("%-6s max error %.3e, rms error %.3e\n",
+            storageFormatStr[i], maxError, sqrt(sqSum / (w * h)));
+    }
+
+    for (i = 0; i < STORAGE_FORMATS_CNT; ++i)
+    {
+        freeWaterSolver(solvers[i]);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* Loads world file repeats times (read, lex, parse) by threadCnt
+ * threads, prints loader throughput. */
+int runWorld(int argc, char ** argv)
+{
+    const char * path = (argc > 2) ? argv[2] : WORLD_PATH_DEFAULT;
+    int repeats = (argc > 3) ? atoi(argv[3]) : WORLD_REPEATS_DEFAULT;
+    int threadCnt = (argc > 4) ? atoi(argv[4]) : 0;
+
+    struct timeval startTime;
+    long length = 0;
+    int objCnt = 0;
+    int vertexCnt = 0;
+    float seconds;
+    char * text;
+    int i;
+
+    if (repeats < 1)
+    {
+        usage(argv[0]);
+    }
+
+    text = getTextFileContent(path, &length);
+    free(text);
+
+    timeval_diff_replace(&startTime);
+
+    for (i = 0; i < repeats; ++i)
+    {
+        World * world = parseWorldThreads(path, threadCnt);
+        const WorldObject * cur;
+
+        objCnt = 0;
+        vertexCnt = 0;
+
+        for (cur = world->objList.first; cur != NULL; cur = cur->next)
+        {
+            ++objCnt;
+            vertexCnt += cur->cnt;
+        }
+
+        freeParsedWorld(world);
+    }
+
+    seconds = timeval_diff_replace(&startTime);
+
+    printf("world: %s, %.2f MB, %d objects, %d vertices, %d repeats, "
+        "%d threads, %.3f s, %.1f MB/s\n",
+        path, length / 1e6, objCnt, vertexCnt, repeats,
+        (threadCnt > 0) ? threadCnt : getProcessorsCount(), seconds,
+        (double) length * repeats / seconds / 1e6);
+
+    return EXIT_SUCCESS;
+}
+
+/* Scans all numbers of world file by strtof() and by scanFloat(),
+ * prints speed of both and count of different results. */
+int runFloats(int argc, char ** argv)
+{
+    const char * path = (argc > 2) ? argv[2] : WORLD_PATH_DEFAULT;
+    int repeats = (argc > 3) ? atoi(argv[3]) : WORLD_REPEATS_DEFAULT;
+
+    WorldLexer * lexer;
+    WorldToken * tokens;
+    WorldToken token;
+    struct timeval startTime;
+    float strtofSeconds, scanSeconds;
+    int tokenCnt = 0;
+    int mismatchCnt = 0;
+    double sum = 0.0;
+    int i, j;
+
+    if (repeats < 1)
+    {
+        usage(argv[0]);
+    }
+
+    lexer = newWorldLexer(path);
+
+    /* Upper bound of tokens count. */
+    tokens = (WorldToken *) malloc((lexer->textLength / 2 + 1) *
+        sizeof(WorldToken));
+
+    /* Tokens are followed by a separator, so strtof() stops at the end
+     * of token. */
+    while (getToken(lexer, &token))
+    {
+        char * endp;
+
+        errno = 0;
+        strtof(token.str, &endp);
+
+        if (errno == 0 && endp == token.str + token.length)
+        {
+            tokens[tokenCnt++] = token;
+        }
+    }
+
+    timeval_diff_replace(&startTime);
+
+    for (i = 0; i < repeats; ++i)
+    {
+        for (j = 0; j < tokenCnt; ++j)
+        {
+            char * endp;
+
+            errno = 0;
+            sum += strtof(tokens[j].str, &endp);
+
+            if (errno != 0 || endp != tokens[j].str + tokens[j].length)
+            {
+                ++mismatchCnt;
+            }
+        }
+    }
+
+    strtofSeconds = timeval_diff_replace(&startTime);
+
+    for (i = 0; i < repeats; ++i)
+    {
+        for (j = 0; j < tokenCnt; ++j)
+        {
+            float f;
+
+            if (! scanFloat(tokens[j].str, tokens[j].length, &f))
+            {
+                ++mismatchCnt;
+            }
+
+            sum -= f;
+        }
+    }
+
+    scanSeconds = timeval_diff_replace(&startTime);
+
+    for (j = 0; j < tokenCnt; ++j)
+    {
+        float f;
+
+        if (! scanFloat(tokens[j].str, tokens[j].length, &f) ||
+            f != strtof(tokens[j].str, NULL))
+        {
+            ++mismatchCnt;
+        }
+    }
+
+    printf("floats: %s, %d numbers, %d repeats, strtof %.1f ns, "
+        "scanFloat %.1f ns, speedup %.1f, mismatches %d, checksum %g\n",
+        path, tokenCnt, repeats,
+        strtofSeconds * 1e9 / ((double) tokenCnt * repeats),
+        scanSeconds * 1e9 / ((double) tokenCnt * repeats),
+        strtofSeconds / scanSeconds, mismatchCnt, sum);
+
+    free(tokens);
+    freeWorldLexer(lexer);
+
+    return EXIT_SUCCESS;
+}
+
+/* Writes compiled world next to text one. */
+int runCompile(int argc, char ** argv)
+{
+    const char * path = (argc > 2) ? argv[2] : WORLD_PATH_DEFAULT;
+    char * binaryPath = getWorldBinaryPath(path);
+    struct timeval startTime;
+    float seconds;
+    World * world;
+    int ok;
+
+    timeval_diff_replace(&startTime);
+
+    ok = compileWorld(path);
+
+    seconds = timeval_diff_replace(&startTime);
+
+    if (ok)
+    {
+        /* Check, that it is loaded back. */
+        world = loadWorldBinary(path);
+        ok = (world != NULL);
+
+        if (ok)
+        {
+            printf("compile: %s -> %s, %d materials, %d objects, "
+                "%.3f s, load %.4f s\n", path, binaryPath,
+                world->mtrlList.cnt, world->objList.cnt, seconds,
+                timeval_diff_replace(&startTime));
+            freeParsedWorld(world);
+        }
+    }
+
+    free(binaryPath);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 2)
+    {
+        usage(argv[0]);
+    }
+
+    if (STR_EQUAL(argv[1], "solver"))
+    {
+        return runSolver(argc, argv);
+    }
+
+    if (STR_EQUAL(argv[1], "precision"))
+    {
+        return runPrecision(argc, argv);
+    }
+
+    if (STR_EQUAL(argv[1], "world"))
+    {
+        return runWorld(argc, argv);
+    }
+
+    if (STR_EQUAL(argv[1], "floats"))
+    {
+        return runFloats(argc, argv);
+    }
+
+    if (STR_EQUAL(argv[1], "compile"))
+    {
+        return runCompile(argc, argv);
+    }
+
+    usage(argv[0]);
+
+    /* Not possible */
+    return EXIT_FAILURE;
+}
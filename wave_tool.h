@@ -0,0 +1,6 @@
+#ifndef WAVE_TOOL_H_SENTRY
+#define WAVE_TOOL_H_SENTRY
+
+/* Nothing to see. */
+
+#endif /* WAVE_TOOL_H_SENTRY */
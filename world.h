@@ -1,113 +1,29 @@
 #ifndef WORLD_H_SENTRY
 #define WORLD_H_SENTRY
 
-#include "matrix.h"
+#include "world_data.h"
 #include "shaders.h"
 #include <GLFW/glfw3.h>
 
-typedef
-struct PointLight
-{
-    vec3 position;
-
-    vec4 ambient;
-    vec4 diffuse;
-    vec4 specular;
-
-    vec3 attenuation;
-}
-PointLight;
-
-typedef
-struct Texture
-{
-    struct Texture * next;
-
-    const char * name;
-    GLuint id;
-    int num;
-}
-Texture;
-
-typedef
-struct TextureList
-{
-    Texture * first;
-    Texture * last;
-    int cnt;
-}
-TextureList;
-
-typedef
-struct Material
-{
-    struct Material * next;
-
-    char * name;
-
-    char * textureName;
-
-    vec4 emission;
-    vec4 ambient;
-    vec4 diffuse;
-    vec4 specular;
-
-    GLfloat shininess;
-}
-Material;
-
-typedef
-struct MaterialList
-{
-    Material * first;
-    Material * last;
-}
-MaterialList;
-
-typedef
-struct WorldObject
-{
-    struct WorldObject * next;
-
-    const char * materialName;
-    GLenum primitiveType; /* I.e. GL_TRIANGLES. */
-
-    GLfloat * position;
-    GLfloat * normal;
-    GLfloat * texCoord;
-    GLsizei cnt;
-
-    GLuint * idx;
-    GLsizei idxCnt;
+World * getWorld(const char * path);
 
-    GLuint vaoP;
-}
-WorldObject;
+Material * getMaterialByName(const MaterialList * list,
+    const char * name);
 
-typedef
-struct WorldObjectList
-{
-    WorldObject * first;
-    WorldObject * last;
-}
-WorldObjectList;
+/* NULL if there is no such texture. */
+Texture * getTextureByName(const TextureList * list,
+    const char * name);
 
-typedef
-struct World
-{
-    PointLight * pointLight;
-    TextureList texList;
-    MaterialList mtrlList;
-    WorldObjectList objList;
+void drawWorld(World * world);
 
-    ShaderProgram * sp;
-}
-World;
+void resetWorldDrawStats(World * world);
 
-World * getWorld(const char * path);
+/* Repacks world geometry. */
+void setWorldVertexFormat(World * world, WorldVertexFormat format);
 
-void drawWorld(World * world);
+const char * getWorldVertexFormatName(WorldVertexFormat format);
 
+/* Binds uniform blocks of sp, water material is "for_water". */
 void setupWater(ShaderProgram * sp, World * world);
 
 void freeWorld(World * world);
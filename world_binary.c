@@ -0,0 +1,655 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#include "world_binary.h"
+#include "world_parser.h"
+#include "world_pack.h"
+#include "string_table.h"
+#include "utils.h"
+
+/* Layout: header, then blocks at offsets from it, each block is aligned
+ * to WORLD_BINARY_ALIGN:
+ * strings -- null-terminated names, referenced by offset in block;
+ * materials -- BinaryMaterial in material list order;
+ * objects -- BinaryObject in object list order;
+ * arrays of objects -- position, normal, texCoord, idx of each object;
+ * vertices, indices -- buffers of render queue.
+ * Numbers are in byte order of the machine, which wrote the file. */
+
+#define WORLD_BINARY_MAGIC "WSWB"
+/* Increase on any change of layout or of packing. */
+#define WORLD_BINARY_VERSION 2
+#define WORLD_BINARY_BYTE_ORDER 0x01020304u
+#define WORLD_BINARY_ALIGN 16
+
+typedef
+struct BinaryHeader
+{
+    char magic[4];
+    unsigned int version;
+    unsigned int byteOrder;
+    unsigned int vertexSize;
+
+    /* Of text world, compiled world is stale, if they differ. Text is
+     * not read to check hash, if modification time is the same. */
+    unsigned int sourceLength;
+    unsigned int sourceHash;
+    unsigned int sourceMtime;
+
+    unsigned int stringsOffset;
+    unsigned int stringsBytes;
+    unsigned int mtrlOffset;
+    unsigned int mtrlCnt;
+    unsigned int objOffset;
+    unsigned int objCnt;
+    unsigned int vertexOffset;
+    unsigned int vertexBytes;
+    unsigned int idxOffset;
+    unsigned int idxBytes;
+
+    unsigned int hasPointLight;
+    PointLight pointLight;
+}
+BinaryHeader;
+
+typedef
+struct BinaryMaterial
+{
+    /* Offsets in strings block. */
+    unsigned int name;
+    unsigned int textureName;
+
+    vec4 emission;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+
+    WorldFloat shininess;
+}
+BinaryMaterial;
+
+typedef
+struct BinaryObject
+{
+    /* Position in material list. */
+    unsigned int material;
+    unsigned int primitiveType;
+
+    unsigned int cnt;
+    unsigned int idxCnt;
+
+    /* Offsets in file. */
+    unsigned int position;
+    unsigned int normal;
+    unsigned int texCoord;
+    unsigned int idx;
+}
+BinaryObject;
+
+char * getWorldBinaryPath(const char * path)
+{
+    char * binaryPath = (char *)
+        malloc(strlen(path) + strlen(WORLD_BINARY_SUFFIX) + 1);
+
+    strcpy(binaryPath, path);
+    strcat(binaryPath, WORLD_BINARY_SUFFIX);
+
+    return binaryPath;
+}
+
+/* ---- Writing ---- */
+
+/* Pads file to alignment, writes block and returns its offset. */
+static unsigned int writeBlock(FILE * file, unsigned int * offsetP,
+    const void * data, unsigned int bytes)
+{
+    static const char zeros[WORLD_BINARY_ALIGN] = {0};
+    unsigned int pad = (WORLD_BINARY_ALIGN - *offsetP % WORLD_BINARY_ALIGN) %
+        WORLD_BINARY_ALIGN;
+    unsigned int offset;
+
+    fwrite(zeros, 1, pad, file);
+    offset = *offsetP + pad;
+
+    fwrite(data, 1, bytes, file);
+    *offsetP = offset + bytes;
+
+    return offset;
+}
+
+/* Strings block: name and texture name of each material. */
+static char * getStringsBlock(const World * world, BinaryMaterial * mtrls,
+    unsigned int * bytesP)
+{
+    const Material * material;
+    unsigned int bytes = 0;
+    char * block;
+    int i;
+
+    for (material = world->mtrlList.first; material != NULL;
+        material = material->next)
+    {
+        bytes += strlen(material->name) + strlen(material->textureName) + 2;
+    }
+
+    block = (char *) malloc(bytes);
+    bytes = 0;
+
+    for (material = world->mtrlList.first, i = 0; material != NULL;
+        material = material->next, ++i)
+    {
+        mtrls[i].name = bytes;
+        strcpy(block + bytes, material->name);
+        bytes += strlen(material->name) + 1;
+
+        mtrls[i].textureName = bytes;
+        strcpy(block + bytes, material->textureName);
+        bytes += strlen(material->textureName) + 1;
+    }
+
+    *bytesP = bytes;
+
+    return block;
+}
+
+static void writeWorldBinary(FILE * file, World * world,
+    BinaryHeader * header)
+{
+    int mtrlCnt = world->mtrlList.cnt;
+    int objCnt = world->objList.cnt;
+    BinaryMaterial * mtrls = (BinaryMaterial *)
+        calloc(mtrlCnt, sizeof(BinaryMaterial));
+    BinaryObject * objs = (BinaryObject *)
+        calloc(objCnt, sizeof(BinaryObject));
+    const Material * material;
+    const WorldObject * obj;
+    unsigned int offset = sizeof(BinaryHeader);
+    char * strings;
+    void * vertices;
+    WorldUint * idx;
+    int i;
+
+    world->geometry.format = WORLD_VERTEX_PACKED;
+    setupWorldBatches(world);
+
+    vertices = malloc(world->geometry.vertexBytes);
+    idx = (WorldUint *) malloc(world->geometry.idxBytes);
+    packWorldVertices(world, vertices);
+    packWorldIndices(world, idx);
+
+    /* Place of header, it is written when offsets are known. */
+    fwrite(header, sizeof(BinaryHeader), 1, file);
+
+    strings = getStringsBlock(world, mtrls, &(header->stringsBytes));
+    header->stringsOffset = writeBlock(file, &offset, strings,
+        header->stringsBytes);
+
+    for (material = world->mtrlList.first, i = 0; material != NULL;
+        material = material->next, ++i)
+    {
+        copyVec4(mtrls[i].emission, material->emission);
+        copyVec4(mtrls[i].ambient, material->ambient);
+        copyVec4(mtrls[i].diffuse, material->diffuse);
+        copyVec4(mtrls[i].specular, material->specular);
+        mtrls[i].shininess = material->shininess;
+    }
+
+    /* Arrays go first, so objects block is written once. */
+    for (obj = world->objList.first, i = 0; obj != NULL;
+        obj = obj->next, ++i)
+    {
+        objs[i].material = obj->material->num;
+        objs[i].primitiveType = obj->primitiveType;
+        objs[i].cnt = obj->cnt;
+        objs[i].idxCnt = obj->idxCnt;
+
+        objs[i].position = writeBlock(file, &offset, obj->position,
+            obj->cnt * 3 * sizeof(WorldFloat));
+        objs[i].normal = writeBlock(file, &offset, obj->normal,
+            obj->cnt * 3 * sizeof(WorldFloat));
+        objs[i].texCoord = writeBlock(file, &offset, obj->texCoord,
+            obj->cnt * 2 * sizeof(WorldFloat));
+        objs[i].idx = writeBlock(file, &offset, obj->idx,
+            obj->idxCnt * sizeof(WorldUint));
+    }
+
+    header->mtrlCnt = mtrlCnt;
+    header->mtrlOffset = writeBlock(file, &offset, mtrls,
+        mtrlCnt * sizeof(BinaryMaterial));
+
+    header->objCnt = objCnt;
+    header->objOffset = writeBlock(file, &offset, objs,
+        objCnt * sizeof(BinaryObject));
+
+    header->vertexBytes = world->geometry.vertexBytes;
+    header->vertexOffset = writeBlock(file, &offset, vertices,
+        header->vertexBytes);
+
+    header->idxBytes = world->geometry.idxBytes;
+    header->idxOffset = writeBlock(file, &offset, idx, header->idxBytes);
+
+    fseek(file, 0L, SEEK_SET);
+    fwrite(header, sizeof(BinaryHeader), 1, file);
+
+    freeWorldBatches(&(world->geometry));
+    free(strings);
+    free(vertices);
+    free(idx);
+    free(mtrls);
+    free(objs);
+}
+
+/* Low bits are enough to notice change. */
+static unsigned int getSourceMtime(const char * path)
+{
+    struct stat st;
+
+    if (stat(path, &st) == -1)
+    {
+        return 0;
+    }
+
+    return (unsigned int) st.st_mtime;
+}
+
+int compileWorld(const char * path)
+{
+    char * binaryPath = getWorldBinaryPath(path);
+    BinaryHeader header;
+    World * world;
+    FILE * file;
+    long length;
+    char * text = getTextFileContent(path, &length);
+    int ok;
+
+    if (text == NULL)
+    {
+        fprintf(stderr, "Can not read world from \"%s\".\n", path);
+        free(binaryPath);
+        return 0;
+    }
+
+    memset(&header, 0, sizeof(BinaryHeader));
+    memcpy(header.magic, WORLD_BINARY_MAGIC, 4);
+    header.version = WORLD_BINARY_VERSION;
+    header.byteOrder = WORLD_BINARY_BYTE_ORDER;
+    header.vertexSize = sizeof(PackedVertex);
+    header.sourceLength = length;
+    header.sourceHash = hashString(text, length);
+    header.sourceMtime = getSourceMtime(path);
+    free(text);
+
+    world = parseWorld(path);
+    setupRenderQueue(world);
+
+    header.hasPointLight = (world->pointLight != NULL);
+
+    if (header.hasPointLight)
+    {
+        header.pointLight = *(world->pointLight);
+    }
+
+    file = fopen(binaryPath, "wb");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "Can not write compiled world to \"%s\".\n",
+            binaryPath);
+        ok = 0;
+    }
+    else
+    {
+        writeWorldBinary(file, world, &header);
+        ok = (ferror(file) == 0);
+        ok = (fclose(file) == 0) && ok;
+
+        if (! ok)
+        {
+            fprintf(stderr, "Can not write compiled world to \"%s\".\n",
+                binaryPath);
+            remove(binaryPath);
+        }
+    }
+
+    free(world->queue);
+    freeParsedWorld(world);
+    free(binaryPath);
+
+    return ok;
+}
+
+/* ---- Loading ---- */
+
+/* Whole file, NULL if it can not be read. */
+static WorldBinary * mapWorldBinary(const char * path)
+{
+    WorldBinary * binary;
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1)
+    {
+        return NULL;
+    }
+
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t) sizeof(BinaryHeader))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    binary = (WorldBinary *) malloc(sizeof(WorldBinary));
+    binary->size = st.st_size;
+
+#ifdef _WIN32
+    binary->data = malloc(binary->size);
+
+    if (read(fd, binary->data, binary->size) != (int) binary->size)
+    {
+        free(binary->data);
+        binary->data = NULL;
+    }
+#else
+    /* Private and writable, as arrays of parsed world: pages are copied
+     * only if somebody writes. */
+    binary->data = mmap(NULL, binary->size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE, fd, 0);
+
+    if (binary->data == MAP_FAILED)
+    {
+        binary->data = NULL;
+    }
+#endif
+
+    close(fd);
+
+    if (binary->data == NULL)
+    {
+        free(binary);
+        return NULL;
+    }
+
+    return binary;
+}
+
+void closeWorldBinary(WorldBinary * binary)
+{
+#ifdef _WIN32
+    free(binary->data);
+#else
+    munmap(binary->data, binary->size);
+#endif
+    free(binary);
+}
+
+static int isBlockInFile(const WorldBinary * binary, size_t offset,
+    size_t bytes)
+{
+    return offset % sizeof(WorldFloat) == 0 && offset <= binary->size &&
+        bytes <= binary->size - offset;
+}
+
+static int isHeaderValid(const WorldBinary * binary,
+    const BinaryHeader * header)
+{
+    return memcmp(header->magic, WORLD_BINARY_MAGIC, 4) == 0 &&
+        header->version == WORLD_BINARY_VERSION &&
+        header->byteOrder == WORLD_BINARY_BYTE_ORDER &&
+        header->vertexSize == sizeof(PackedVertex) &&
+        isBlockInFile(binary, header->stringsOffset, header->stringsBytes) &&
+        header->mtrlCnt <= binary->size / sizeof(BinaryMaterial) &&
+        isBlockInFile(binary, header->mtrlOffset,
+            header->mtrlCnt * sizeof(BinaryMaterial)) &&
+        header->objCnt <= binary->size / sizeof(BinaryObject) &&
+        isBlockInFile(binary, header->objOffset,
+            header->objCnt * sizeof(BinaryObject)) &&
+        isBlockInFile(binary, header->vertexOffset, header->vertexBytes) &&
+        isBlockInFile(binary, header->idxOffset, header->idxBytes) &&
+        (header->stringsBytes == 0 || ((const char *) binary->data)
+            [header->stringsOffset + header->stringsBytes - 1] == '\0');
+}
+
+/* Compiled world is stale, if text world differs. Without text world
+ * compiled one is used as is. */
+static int isSourceChanged(const char * path, const BinaryHeader * header)
+{
+    struct stat st;
+    long length;
+    char * text;
+    int changed;
+
+    if (stat(path, &st) == -1)
+    {
+        return 0;
+    }
+
+    if ((unsigned int) st.st_size == header->sourceLength &&
+        (unsigned int) st.st_mtime == header->sourceMtime)
+    {
+        return 0;
+    }
+
+    text = getTextFileContent(path, &length);
+
+    if (text == NULL)
+    {
+        return 0;
+    }
+
+    changed = ((unsigned int) length != header->sourceLength ||
+        hashString(text, length) != header->sourceHash);
+
+    free(text);
+
+    return changed;
+}
+
+/* String at offset in strings block, NULL if offset is out of it. */
+static const char * getBinaryString(World * world,
+    const WorldBinary * binary, const BinaryHeader * header,
+    unsigned int offset)
+{
+    const char * str;
+
+    if (offset >= header->stringsBytes)
+    {
+        return NULL;
+    }
+
+    str = (const char *) binary->data + header->stringsOffset + offset;
+
+    return internString(world->names, str, strlen(str));
+}
+
+/* Returns 0, if some block is out of file. */
+static int getBinaryMaterials(World * world, const WorldBinary * binary,
+    const BinaryHeader * header)
+{
+    const BinaryMaterial * mtrls = (const BinaryMaterial *)
+        ((const char *) binary->data + header->mtrlOffset);
+    unsigned int i;
+
+    for (i = 0; i < header->mtrlCnt; ++i)
+    {
+        Material * material = (Material *) malloc(sizeof(Material));
+
+        material->next = NULL;
+        material->name = getBinaryString(world, binary, header,
+            mtrls[i].name);
+        material->textureName = getBinaryString(world, binary, header,
+            mtrls[i].textureName);
+        material->texture = NULL;
+
+        copyVec4(material->emission, mtrls[i].emission);
+        copyVec4(material->ambient, mtrls[i].ambient);
+        copyVec4(material->diffuse, mtrls[i].diffuse);
+        copyVec4(material->specular, mtrls[i].specular);
+        material->shininess = mtrls[i].shininess;
+
+        if (material->name == NULL || material->textureName == NULL)
+        {
+            free(material);
+            return 0;
+        }
+
+        addMaterial(&(world->mtrlList), material);
+    }
+
+    return 1;
+}
+
+/* Indices of object are below its vertex count. */
+static int isObjectIdxValid(const WorldUint * idx, unsigned int idxCnt,
+    unsigned int cnt)
+{
+    unsigned int i;
+
+    for (i = 0; i < idxCnt; ++i)
+    {
+        if (idx[i] >= cnt)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int getBinaryObjects(World * world, const WorldBinary * binary,
+    const BinaryHeader * header, Material ** mtrls)
+{
+    const BinaryObject * objs = (const BinaryObject *)
+        ((const char *) binary->data + header->objOffset);
+    char * data = (char *) binary->data;
+    unsigned int i;
+
+    for (i = 0; i < header->objCnt; ++i)
+    {
+        const BinaryObject * cur = objs + i;
+        WorldObject * obj;
+
+        /* Parser makes only triangles. */
+        if (cur->material >= header->mtrlCnt ||
+            cur->primitiveType != WORLD_TRIANGLES ||
+            cur->idxCnt % 3 != 0 ||
+            cur->cnt > binary->size / (3 * sizeof(WorldFloat)) ||
+            cur->idxCnt > binary->size / sizeof(WorldUint) ||
+            ! isBlockInFile(binary, cur->position,
+                cur->cnt * 3 * sizeof(WorldFloat)) ||
+            ! isBlockInFile(binary, cur->normal,
+                cur->cnt * 3 * sizeof(WorldFloat)) ||
+            ! isBlockInFile(binary, cur->texCoord,
+                cur->cnt * 2 * sizeof(WorldFloat)) ||
+            ! isBlockInFile(binary, cur->idx, cur->idxCnt * sizeof(WorldUint)) ||
+            ! isObjectIdxValid((const WorldUint *) (data + cur->idx),
+                cur->idxCnt, cur->cnt))
+        {
+            return 0;
+        }
+
+        obj = (WorldObject *) malloc(sizeof(WorldObject));
+
+        obj->next = NULL;
+        obj->material = mtrls[cur->material];
+        obj->materialName = obj->material->name;
+        obj->primitiveType = cur->primitiveType;
+
+        obj->position = (WorldFloat *) (data + cur->position);
+        obj->normal = (WorldFloat *) (data + cur->normal);
+        obj->texCoord = (WorldFloat *) (data + cur->texCoord);
+        obj->cnt = cur->cnt;
+
+        obj->idx = (WorldUint *) (data + cur->idx);
+        obj->idxCnt = cur->idxCnt;
+
+        addWorldObject(&(world->objList), obj);
+    }
+
+    return 1;
+}
+
+World * loadWorldBinary(const char * path)
+{
+    char * binaryPath = getWorldBinaryPath(path);
+    WorldBinary * binary = mapWorldBinary(binaryPath);
+    const BinaryHeader * header;
+    Material ** mtrls;
+    Material * material;
+    World * world;
+    int ok;
+
+    if (binary == NULL)
+    {
+        free(binaryPath);
+        return NULL;
+    }
+
+    header = (const BinaryHeader *) binary->data;
+
+    if (! isHeaderValid(binary, header))
+    {
+        fprintf(stderr, "Compiled world \"%s\" is of other version or "
+            "broken, reading \"%s\".\n", binaryPath, path);
+        closeWorldBinary(binary);
+        free(binaryPath);
+        return NULL;
+    }
+
+    if (isSourceChanged(path, header))
+    {
+        fprintf(stderr, "Compiled world \"%s\" is stale, reading \"%s\".\n",
+            binaryPath, path);
+        closeWorldBinary(binary);
+        free(binaryPath);
+        return NULL;
+    }
+
+    binary->vertices = (const char *) binary->data + header->vertexOffset;
+    binary->vertexBytes = header->vertexBytes;
+    binary->idx = (const WorldUint *)
+        ((const char *) binary->data + header->idxOffset);
+    binary->idxBytes = header->idxBytes;
+
+    world = newParsedWorld();
+    world->binary = binary;
+
+    if (header->hasPointLight)
+    {
+        world->pointLight = (PointLight *) malloc(sizeof(PointLight));
+        *(world->pointLight) = header->pointLight;
+    }
+
+    ok = getBinaryMaterials(world, binary, header);
+
+    /* Materials by number for objects. */
+    mtrls = (Material **) malloc(world->mtrlList.cnt * sizeof(Material *));
+
+    for (material = world->mtrlList.first; material != NULL;
+        material = material->next)
+    {
+        mtrls[material->num] = material;
+    }
+
+    ok = ok && getBinaryObjects(world, binary, header, mtrls);
+
+    free(mtrls);
+
+    if (! ok)
+    {
+        fprintf(stderr, "Compiled world \"%s\" is broken, reading "
+            "\"%s\".\n", binaryPath, path);
+        freeParsedWorld(world);
+        world = NULL;
+    }
+
+    free(binaryPath);
+
+    return world;
+}
@@ -0,0 +1,44 @@
+#ifndef WORLD_BINARY_H_SENTRY
+#define WORLD_BINARY_H_SENTRY
+
+#include <stddef.h>
+#include "world_data.h"
+
+/* Compiled world: materials, objects arrays and packed vertex and index
+ * buffers of render queue, ready to upload. It is path of text world
+ * with WORLD_BINARY_SUFFIX, built by "WaveTool compile". */
+
+#define WORLD_BINARY_SUFFIX ".bin"
+
+typedef
+struct WorldBinary
+{
+    /* Whole file. */
+    void * data;
+    size_t size;
+
+    /* WORLD_VERTEX_PACKED vertices and indices of render queue. */
+    const void * vertices;
+    ptrdiff_t vertexBytes;
+    const WorldUint * idx;
+    ptrdiff_t idxBytes;
+}
+WorldBinary;
+
+/* Allocated path + WORLD_BINARY_SUFFIX. */
+char * getWorldBinaryPath(const char * path);
+
+/* Reads text world path and writes its compiled world. Returns 0 and
+ * prints message on failure. */
+int compileWorld(const char * path);
+
+/* Maps compiled world of text world path. NULL, if there is no compiled
+ * world or it is stale (other version or text world is changed): then
+ * text world should be read. Textures and OpenGL objects are not set
+ * up, as with parseWorld(). */
+World * loadWorldBinary(const char * path);
+
+/* Unmaps file, it is done by freeParsedWorld(). */
+void closeWorldBinary(WorldBinary * binary);
+
+#endif /* WORLD_BINARY_H_SENTRY */
@@ -0,0 +1,241 @@
+#ifndef WORLD_DATA_H_SENTRY
+#define WORLD_DATA_H_SENTRY
+
+#include <stddef.h>
+#include "matrix.h"
+#include "string_table.h"
+
+/* World types without OpenGL headers, so parser, packer and compiled
+ * world are built into WaveTool without GLEW and GLFW. Types below are
+ * the same as GLfloat, GLuint, GLint, GLhalf; GLsizei is WorldInt,
+ * GLsizeiptr is ptrdiff_t. */
+
+typedef float WorldFloat;
+typedef unsigned int WorldUint;
+typedef int WorldInt;
+typedef unsigned short WorldHalf;
+
+/* GL_TRIANGLES. */
+#define WORLD_TRIANGLES 0x0004
+
+/* Texture name of material without texture. */
+#define WORLD_NO_TEXTURE "EMPTY"
+
+typedef
+struct PointLight
+{
+    vec3 position;
+
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+
+    vec3 attenuation;
+}
+PointLight;
+
+typedef
+struct Texture
+{
+    struct Texture * next;
+
+    const char * name;
+    WorldUint id;
+    int num;
+}
+Texture;
+
+typedef
+struct TextureList
+{
+    Texture * first;
+    Texture * last;
+    int cnt;
+
+    /* Textures by file name. */
+    NameIndex index;
+}
+TextureList;
+
+typedef
+struct Material
+{
+    struct Material * next;
+
+    /* Names are interned in World.names. */
+    const char * name;
+
+    const char * textureName;
+    /* Resolved from textureName at load time, NULL if there is no
+     * texture. */
+    Texture * texture;
+    /* Texture->num of the texture, -1 if there is no texture. Known
+     * without OpenGL, so render queue is too. */
+    int textureNum;
+    /* Position in material list and slot in material buffer. */
+    int num;
+
+    vec4 emission;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+
+    WorldFloat shininess;
+}
+Material;
+
+typedef
+struct MaterialList
+{
+    Material * first;
+    Material * last;
+    int cnt;
+
+    /* Materials by name. */
+    NameIndex index;
+}
+MaterialList;
+
+typedef
+struct WorldObject
+{
+    struct WorldObject * next;
+
+    /* Interned in World.names. */
+    const char * materialName;
+    /* Resolved from materialName at load time. */
+    Material * material;
+    WorldUint primitiveType; /* I.e. WORLD_TRIANGLES. */
+
+    WorldFloat * position;
+    WorldFloat * normal;
+    WorldFloat * texCoord;
+    WorldInt cnt;
+
+    WorldUint * idx;
+    WorldInt idxCnt;
+
+    /* Position in object list. */
+    int num;
+}
+WorldObject;
+
+typedef
+struct WorldObjectList
+{
+    WorldObject * first;
+    WorldObject * last;
+    int cnt;
+}
+WorldObjectList;
+
+/* Layout of interleaved world vertex: position, normal, texCoord. */
+typedef
+enum WorldVertexFormat
+{
+    /* 32 bytes: all floats. */
+    WORLD_VERTEX_FLOAT,
+    /* 20 bytes: float position, 2_10_10_10 normal, half texCoord. */
+    WORLD_VERTEX_PACKED,
+    WORLD_VERTEX_FORMATS_CNT
+}
+WorldVertexFormat;
+
+/* Objects of the same material, primitive type and vertex format,
+ * adjacent in render queue, they are drawn by one
+ * glMultiDrawElementsBaseVertex(). */
+typedef
+struct WorldBatch
+{
+    const Material * material;
+    WorldUint primitiveType;
+    WorldVertexFormat format;
+
+    /* Per object arrays, parts of WorldGeometry ones. */
+    WorldInt drawCnt;
+    WorldInt * idxCnt;
+    const void ** idxOffset;
+    WorldInt * baseVertex;
+}
+WorldBatch;
+
+/* All world objects in one interleaved vertex buffer and one index
+ * buffer, in render queue order. */
+typedef
+struct WorldGeometry
+{
+    WorldVertexFormat format;
+
+    /* Vertex array of each vertex format over the same buffers. */
+    WorldUint vaoP[WORLD_VERTEX_FORMATS_CNT];
+    WorldUint vboP;
+    WorldUint idxVboP;
+
+    /* Sizes of buffers. */
+    ptrdiff_t vertexBytes;
+    ptrdiff_t idxBytes;
+
+    /* Packed vertices go first, float ones start here. In packed format
+     * objects with texture coordinates not exact in half floats keep
+     * float vertices. */
+    ptrdiff_t floatVertexOffset;
+
+    /* Per object: index count, offset of first index in bytes and base
+     * vertex. */
+    WorldInt * idxCnt;
+    const void ** idxOffset;
+    WorldInt * baseVertex;
+
+    WorldBatch * batches;
+    int batchCnt;
+}
+WorldGeometry;
+
+/* State changes of drawWorld() since the last reset. */
+typedef
+struct WorldDrawStats
+{
+    /* Multi-draw calls, one per batch. */
+    int drawCnt;
+    /* Texture and material binds done. */
+    int changeCnt;
+    /* Texture and material binds avoided. */
+    int skipCnt;
+}
+WorldDrawStats;
+
+typedef
+struct World
+{
+    /* Names of materials, textures and attributes. */
+    StringTable * names;
+
+    PointLight * pointLight;
+    TextureList texList;
+    MaterialList mtrlList;
+    WorldObjectList objList;
+
+    /* Objects sorted by texture and material, so each of them is set
+     * up once per drawWorld(). Program is the same for all. */
+    WorldObject ** queue;
+
+    struct ShaderProgram * sp;
+    WorldGeometry geometry;
+
+    /* Buffers of std140 PointLight and Material blocks, uploaded at load
+     * time. Material buffer has slot for each material. */
+    struct UniformBuffer * pointLightBuffer;
+    struct UniformBuffer * mtrlBuffer;
+
+    /* Material bound to UNIFORM_BINDING_MATERIAL, NULL -- none yet. */
+    const Material * curMaterial;
+
+    WorldDrawStats stats;
+
+    /* Mapped compiled world, objects arrays point into it; NULL, if the
+     * world is read from text. */
+    struct WorldBinary * binary;
+}
+World;
+
+#endif /* WORLD_DATA_H_SENTRY */
@@ -1,17 +1,115 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdarg.h>
 #include "world_lexer.h"
 #include "utils.h"
 
-/* TODO: rewrite as finite-state machine. */
+/* Table-driven finite-state machine: state and class of next character
+ * give next state or action. */
+
+typedef
+enum CharClass
+{
+    CHAR_OTHER,
+    /* ' ', '\t', '\r'. */
+    CHAR_SPACE,
+    CHAR_NEWLINE,
+    CHAR_SLASH,
+    /* Lexeme by itself: '{', '}', '"', '[', ']'. */
+    CHAR_SINGLE,
+    /* '\0'. */
+    CHAR_END,
+    CHAR_CLASSES_CNT
+}
+CharClass;
+
+typedef
+enum LexState
+{
+    LEX_SPACE,
+    LEX_WORD,
+    /* Word which ends with '/', it can be start of comment. */
+    LEX_SLASH,
+    LEX_COMMENT,
+    LEX_STATES_CNT,
+
+    /* Actions. */
+
+    /* Token ends before current character. */
+    LEX_EMIT,
+    /* Current character is token. */
+    LEX_SINGLE,
+    /* Previous '/' starts comment. */
+    LEX_COMMENT_START,
+    LEX_EOF
+}
+LexState;
+
+#define O CHAR_OTHER
+#define S CHAR_SPACE
+#define N CHAR_NEWLINE
+#define L CHAR_SLASH
+#define B CHAR_SINGLE
+#define E CHAR_END
+
+static const unsigned char charClasses[256] =
+{
+    E, O, O, O, O, O, O, O, O, S, N, O, O, S, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    S, O, B, O, O, O, O, O, O, O, O, O, O, O, O, L,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, B, O, B, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, B, O, B, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O,
+    O, O, O, O, O, O, O, O, O, O, O, O, O, O, O, O
+};
+
+#undef O
+#undef S
+#undef N
+#undef L
+#undef B
+#undef E
+
+/* Indexed by LexState (not actions) and CharClass. */
+static const unsigned char transitions[LEX_STATES_CNT][CHAR_CLASSES_CNT] =
+{
+    /* LEX_SPACE */
+    {LEX_WORD, LEX_SPACE, LEX_SPACE, LEX_SLASH, LEX_SINGLE, LEX_EOF},
+    /* LEX_WORD */
+    {LEX_WORD, LEX_EMIT, LEX_EMIT, LEX_SLASH, LEX_EMIT, LEX_EMIT},
+    /* LEX_SLASH */
+    {LEX_WORD, LEX_EMIT, LEX_EMIT, LEX_COMMENT_START, LEX_EMIT, LEX_EMIT},
+    /* LEX_COMMENT */
+    {LEX_COMMENT, LEX_COMMENT, LEX_SPACE, LEX_COMMENT, LEX_COMMENT,
+        LEX_EOF}
+};
 
 WorldLexer * newWorldLexer(const char * path)
 {
     WorldLexer * lexer = (WorldLexer *) malloc(sizeof(WorldLexer));
 
+    lexer->path = path;
     lexer->text = getTextFileContent(path, &(lexer->textLength));
+
+    if (lexer->text == NULL)
+    {
+        fprintf(stderr, "Can not read world from \"%s\".\n", path);
+        exit(EXIT_FAILURE);
+    }
+
     lexer->pos = lexer->text;
+    lexer->names = NULL;
+    lexer->errorJump = NULL;
 
     return lexer;
 }
@@ -22,124 +120,179 @@ void freeWorldLexer(WorldLexer * lexer)
     free(lexer);
 }
 
-void skipSpaces(WorldLexer * lexer)
+static int setToken(WorldLexer * lexer, WorldToken * token,
+    const char * start, const char * end)
 {
-    char c = *(lexer->pos);
+    token->str = start;
+    token->length = (int) (end - start);
 
-    while (c == ' ' || c == '\n')
-    {
-        ++(lexer->pos);
-        c = *(lexer->pos);
-    }
+    lexer->pos = end;
+
+    return 1;
 }
 
-void skipLex(WorldLexer * lexer)
+int getToken(WorldLexer * lexer, WorldToken * token)
 {
-    char c = *(lexer->pos);
+    const char * p = lexer->pos;
+    const char * start = p;
+    int state = LEX_SPACE;
 
-    while (c != ' ' && c != '\n' && c != '\0')
+    for (;; ++p)
     {
-        ++(lexer->pos);
-        c = *(lexer->pos);
-    }
-}
+        int next = transitions[state][charClasses[(unsigned char) *p]];
 
-void skipLine(WorldLexer * lexer)
-{
-    char c = *(lexer->pos);
+        if (next == state)
+        {
+            continue;
+        }
 
-    while (c != '\n' && c != '\0')
-    {
-        ++(lexer->pos);
-        c = *(lexer->pos);
-    }
+        switch (next)
+        {
+            case LEX_EMIT:
+                return setToken(lexer, token, start, p);
+            case LEX_SINGLE:
+                return setToken(lexer, token, p, p + 1);
+            case LEX_COMMENT_START:
+                if (p - 1 > start)
+                {
+                    return setToken(lexer, token, start, p - 1);
+                }
 
-    if (c != '\0')
-    {
-        ++(lexer->pos);
+                next = LEX_COMMENT;
+                break;
+            case LEX_EOF:
+                lexer->pos = p;
+                return 0;
+            case LEX_WORD:
+            case LEX_SLASH:
+                if (state == LEX_SPACE)
+                {
+                    start = p;
+                }
+                break;
+            default:
+                break;
+        }
+
+        state = next;
     }
 }
 
-char * getLex(WorldLexer * lexer)
+int skipBlock(WorldLexer * lexer)
 {
-    char * lex = (char *) malloc(sizeof(char) * (MAX_LEX_LENGTH + 1));
-    int lexPos = 0;
-    char c;
+    WorldToken token;
+    const char * p;
+    int depth = 1;
+    int quoted = 0;
 
-    skipSpaces(lexer);
-    c = *(lexer->pos);
+    if (! getToken(lexer, &token) || ! isToken(&token, "{"))
+    {
+        return 0;
+    }
 
-    while (c != ' ' && c != '\n' && c != '\0' &&
-        lexPos < MAX_LEX_LENGTH)
+    for (p = lexer->pos;; ++p)
     {
-        if (c == '/' && lexer->pos[1] == '/')
+        switch (charClasses[(unsigned char) *p])
         {
-            skipLine(lexer);
-            skipSpaces(lexer);
-            c = *(lexer->pos);
-
-            if (lexPos == 0)
-            {
-                continue;
-            }
-            else
-            {
+            case CHAR_END:
+                lexer->pos = p;
+                return 0;
+            case CHAR_SLASH:
+                /* Comment starts by "//" anywhere, as in getToken(). */
+                if (p[1] == '/')
+                {
+                    while (p[1] != '\n' && p[1] != '\0')
+                    {
+                        ++p;
+                    }
+                }
+                break;
+            case CHAR_SINGLE:
+                if (*p == '"')
+                {
+                    quoted = ! quoted;
+                }
+                else if (! quoted && *p == '{')
+                {
+                    ++depth;
+                }
+                else if (! quoted && *p == '}' && --depth == 0)
+                {
+                    lexer->pos = p + 1;
+                    return 1;
+                }
+                break;
+            default:
                 break;
-            }
         }
+    }
+}
 
-        if ((c == '{' || c == '}' || c == '\"' ||
-            c == '[' || c == ']') && lexPos > 0)
-        {
-            break;
-        }
+void getTokenNotEof(WorldLexer * lexer, WorldToken * token)
+{
+    if (! getToken(lexer, token))
+    {
+        worldLexerError(lexer, NULL, "unexpected EOF.\n");
+    }
+}
 
-        lex[lexPos] = c;
-        ++lexPos;
-        ++(lexer->pos);
+int isToken(const WorldToken * token, const char * str)
+{
+    return strncmp(token->str, str, token->length) == 0 &&
+        str[token->length] == '\0';
+}
 
-        if ((c == '{' || c == '}' || c == '\"' ||
-            c == '[' || c == ']') && lexPos == 1)
-        {
-            break;
-        }
+const char * internToken(WorldLexer * lexer, const WorldToken * token)
+{
+    return internString(lexer->names, token->str, token->length);
+}
 
-        c = *(lexer->pos);
-    }
+void checkNextLex(WorldLexer * lexer, const char * pattern)
+{
+    WorldToken token;
 
-    if (lexPos == 0)
+    if (! getToken(lexer, &token))
     {
-        free(lex);
-        return NULL;
+        worldLexerError(lexer, NULL, "unexpected EOF, expected \"%s\".\n",
+            pattern);
     }
 
-    lex[lexPos] = '\0';
-
-    if (lexPos == MAX_LEX_LENGTH)
+    if (! isToken(&token, pattern))
     {
-        skipLex(lexer);
+        worldLexerError(lexer, &token, "\"%.*s\" is not \"%s\".\n",
+            token.length, token.str, pattern);
     }
-
-    return lex;
 }
 
-void checkNextLex(WorldLexer * lexer, const char * pattern)
+void worldLexerError(const WorldLexer * lexer, const WorldToken * token,
+    const char * fmt, ...)
 {
-    char * lex = getLex(lexer);
+    va_list ap;
+    const char * pos = (token != NULL) ? token->str : lexer->pos;
+    const char * lineStart = lexer->text;
+    const char * p;
+    int line = 1;
 
-    if (lex == NULL)
+    if (lexer->errorJump != NULL)
     {
-        fprintf(stderr, "checkNextLex(\"%s\") error: unexpected EOF.\n",
-            pattern);
-        exit(EXIT_FAILURE);
+        longjmp(*(lexer->errorJump), 1);
     }
-        
-    if (! STR_EQUAL(lex, pattern))
+
+    for (p = lexer->text; p < pos; ++p)
     {
-        fprintf(stderr, "checkNextLex() error: \"%s\" is not \"%s\".\n",
-            lex, pattern);
-        exit(EXIT_FAILURE);
+        if (*p == '\n')
+        {
+            ++line;
+            lineStart = p + 1;
+        }
     }
 
-    free(lex);
+    fprintf(stderr, "%s:%d:%d: ", lexer->path, line,
+        (int) (pos - lineStart) + 1);
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    exit(EXIT_FAILURE);
 }
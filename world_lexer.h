@@ -1,25 +1,73 @@
 #ifndef WORLD_LEXER_H_SENTRY
 #define WORLD_LEXER_H_SENTRY
 
-#define MAX_LEX_LENGTH 128
+#include <setjmp.h>
+#include "string_table.h"
+
+/* Lexemes are separated by spaces and line ends, "{", "}", "\"", "[",
+ * "]" are lexemes by themselves, "//" comments out the rest of line.
+ * Tokens are views into text of the lexer, nothing is allocated per
+ * token. */
+
+typedef
+struct WorldToken
+{
+    /* Not null-terminated, but always followed by a character which
+     * ends the lexeme (or by '\0'). */
+    const char * str;
+    int length;
+}
+WorldToken;
 
 typedef
 struct WorldLexer
 {
-    char * pos;
+    const char * path;
+
     char * text;
     long textLength;
+
+    const char * pos;
+
+    /* Names are interned here by internToken(), set by user of lexer. */
+    StringTable * names;
+
+    /* NULL (default) -- errors exit. Lexer of a worker thread, which
+     * must not exit, sets it: errors jump here with value 1. */
+    jmp_buf * errorJump;
 }
 WorldLexer;
 
+/* Exit, if file can not be read. */
 WorldLexer * newWorldLexer(const char * path);
 
 void freeWorldLexer(WorldLexer * lexer);
 
-/* NULL at EOF. */
-char * getLex(WorldLexer * lexer);
+/* 0 at EOF. */
+int getToken(WorldLexer * lexer, WorldToken * token);
+
+/* Moves lexer after balanced block "{ ... }", which is the next token,
+ * without making tokens: only braces out of comments and quotes are
+ * counted, contents are not checked. 0 if there is no "{" or EOF is
+ * reached. */
+int skipBlock(WorldLexer * lexer);
+
+/* Exit at EOF. */
+void getTokenNotEof(WorldLexer * lexer, WorldToken * token);
+
+int isToken(const WorldToken * token, const char * str);
+
+/* Interned null-terminated copy of token. */
+const char * internToken(WorldLexer * lexer, const WorldToken * token);
 
 /* Exit, if not match. */
 void checkNextLex(WorldLexer * lexer, const char * pattern);
 
+/* Prints "path:line:column: " and message and exits (or only jumps to
+ * errorJump of lexer, if it is set). token can be NULL for current
+ * position of lexer. Line and column are counted only here, so lexing
+ * does not track them. */
+void worldLexerError(const WorldLexer * lexer, const WorldToken * token,
+    const char * fmt, ...);
+
 #endif /* WORLD_LEXER_H_SENTRY */
@@ -0,0 +1,353 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "world_pack.h"
+#include "world_parser.h"
+#include "string_table.h"
+#include "utils.h"
+
+/* Indexed by WorldVertexFormat. */
+static const WorldInt vertexFormatSizes[] =
+{
+    sizeof(FloatVertex),
+    sizeof(PackedVertex)
+};
+
+WorldInt getWorldVertexSize(WorldVertexFormat format)
+{
+    return vertexFormatSizes[format];
+}
+
+/* Order of render queue: texture, then material, then object list. */
+static int compareQueueObjects(const void * a, const void * b)
+{
+    const WorldObject * objA = *((WorldObject * const *) a);
+    const WorldObject * objB = *((WorldObject * const *) b);
+    int diff;
+
+    diff = objA->material->textureNum - objB->material->textureNum;
+
+    if (diff == 0)
+    {
+        diff = objA->material->num - objB->material->num;
+    }
+
+    if (diff == 0)
+    {
+        diff = objA->num - objB->num;
+    }
+
+    return diff;
+}
+
+/* The same numbers as textures get in getWorld(). */
+static void setupTextureNums(World * world)
+{
+    NameIndex index;
+    Material * material;
+    int cnt = 0;
+
+    initNameIndex(&index);
+
+    for (material = world->mtrlList.first; material != NULL;
+        material = material->next)
+    {
+        Material * first;
+
+        if (STR_EQUAL(material->textureName, WORLD_NO_TEXTURE))
+        {
+            material->textureNum = -1;
+            continue;
+        }
+
+        first = (Material *) addToNameIndex(&index, material->textureName,
+            material);
+
+        material->textureNum = (first == NULL) ? cnt++ : first->textureNum;
+    }
+
+    freeNameIndex(&index);
+}
+
+void setupRenderQueue(World * world)
+{
+    WorldObject * cur;
+    int i = 0;
+
+    setupTextureNums(world);
+
+    world->queue = (WorldObject **)
+        malloc(world->objList.cnt * sizeof(WorldObject *));
+
+    for (cur = world->objList.first; cur != NULL; cur = cur->next)
+    {
+        world->queue[i++] = cur;
+    }
+
+    qsort(world->queue, world->objList.cnt, sizeof(WorldObject *),
+        compareQueueObjects);
+}
+
+/* Signed normalized 10-bit components, w is 0. OpenGL 3.3 decodes
+ * component i as (2 * i + 1) / 1023 (not as i / 511 of 4.2), so i is
+ * nearest to (1023 * c - 1) / 2: from -512 for -1 to 511 for 1. */
+static WorldUint packNormal(const WorldFloat * n)
+{
+    WorldUint packed = 0;
+    int k;
+
+    for (k = 0; k < 3; ++k)
+    {
+        float c = (n[k] < -1.0f) ? -1.0f : ((n[k] > 1.0f) ? 1.0f : n[k]);
+        int i = (int) floor(c * 511.5f);
+
+        packed |= ((WorldUint) i & 0x3ffu) << (10 * k);
+    }
+
+    return packed;
+}
+
+/* Nearest half precision float, ties are rounded up. Values below
+ * 2^-14 are flushed to zero, above 65504 are clamped. */
+static WorldHalf packHalf(float f)
+{
+    union
+    {
+        float f;
+        unsigned int u;
+    }
+    v;
+    unsigned int sign, u;
+
+    v.f = f;
+    sign = (v.u >> 16) & 0x8000u;
+    u = v.u & 0x7fffffffu;
+
+    if (u < 0x38800000u)
+    {
+        return (WorldHalf) sign;
+    }
+
+    if (u >= 0x477ff000u)
+    {
+        return (WorldHalf) (sign | 0x7bffu);
+    }
+
+    /* Rounding carry goes to exponent. */
+    u += 0x1000u;
+
+    return (WorldHalf) (sign | (((u >> 23) - 112u) << 10) |
+        ((u >> 13) & 0x3ffu));
+}
+
+/* 1 if half float keeps f exactly: zero or normal half float, packHalf()
+ * flushes smaller values. */
+static int isHalfExact(float f)
+{
+    union
+    {
+        float f;
+        unsigned int u;
+    }
+    v;
+    unsigned int u;
+
+    v.f = f;
+    u = v.u & 0x7fffffffu;
+
+    return (u == 0 || (u >= 0x38800000u && u <= 0x477fe000u &&
+        (u & 0x1fffu) == 0));
+}
+
+/* Format of vertices of obj in geometry of format. Packed objects keep
+ * float vertices, if some texture coordinate is not exact in half floats
+ * (e.g. HorizMesh with k * 20 / 19 is off by up to 2^-7 above 16). */
+static WorldVertexFormat getObjectVertexFormat(const WorldObject * obj,
+    WorldVertexFormat format)
+{
+    int i;
+
+    if (format == WORLD_VERTEX_FLOAT)
+    {
+        return format;
+    }
+
+    for (i = 0; i < 2 * obj->cnt; ++i)
+    {
+        if (! isHalfExact(obj->texCoord[i]))
+        {
+            return WORLD_VERTEX_FLOAT;
+        }
+    }
+
+    return WORLD_VERTEX_PACKED;
+}
+
+/* Writes vertices of obj to dst in format. */
+static void packVertices(void * dst, WorldVertexFormat format,
+    const WorldObject * obj)
+{
+    FloatVertex * fv = (FloatVertex *) dst;
+    PackedVertex * pv = (PackedVertex *) dst;
+    int i, k;
+
+    for (i = 0; i < obj->cnt; ++i)
+    {
+        const WorldFloat * position = obj->position + 3 * i;
+        const WorldFloat * normal = obj->normal + 3 * i;
+        const WorldFloat * texCoord = obj->texCoord + 2 * i;
+
+        if (format == WORLD_VERTEX_FLOAT)
+        {
+            copyVec3(fv[i].position, position);
+            copyVec3(fv[i].normal, normal);
+            fv[i].texCoord[0] = texCoord[0];
+            fv[i].texCoord[1] = texCoord[1];
+            continue;
+        }
+
+        for (k = 0; k < 3; ++k)
+        {
+            pv[i].position[k] = position[k];
+        }
+
+        pv[i].normal = packNormal(normal);
+        pv[i].texCoord[0] = packHalf(texCoord[0]);
+        pv[i].texCoord[1] = packHalf(texCoord[1]);
+    }
+}
+
+/* Opens new batch, if obj does not fit in the last one. */
+static WorldBatch * getWorldBatch(WorldGeometry * geometry,
+    const WorldObject * obj, WorldVertexFormat format, int objNum)
+{
+    WorldBatch * batch;
+
+    if (geometry->batchCnt > 0)
+    {
+        batch = geometry->batches + geometry->batchCnt - 1;
+
+        if (batch->material == obj->material &&
+            batch->primitiveType == obj->primitiveType &&
+            batch->format == format)
+        {
+            return batch;
+        }
+    }
+
+    batch = geometry->batches + (geometry->batchCnt)++;
+
+    batch->material = obj->material;
+    batch->primitiveType = obj->primitiveType;
+    batch->format = format;
+    batch->drawCnt = 0;
+    batch->idxCnt = geometry->idxCnt + objNum;
+    batch->idxOffset = geometry->idxOffset + objNum;
+    batch->baseVertex = geometry->baseVertex + objNum;
+
+    return batch;
+}
+
+void setupWorldBatches(World * world)
+{
+    WorldGeometry * geometry = &(world->geometry);
+    int cnt = world->objList.cnt;
+    /* Vertices of each format are counted from its own start. */
+    WorldInt vertexCnt[WORLD_VERTEX_FORMATS_CNT];
+    WorldInt idxCnt = 0;
+    int i;
+
+    vertexCnt[WORLD_VERTEX_FLOAT] = 0;
+    vertexCnt[WORLD_VERTEX_PACKED] = 0;
+
+    geometry->idxCnt = (WorldInt *) malloc(cnt * sizeof(WorldInt));
+    geometry->idxOffset = (const void **)
+        malloc(cnt * sizeof(const void *));
+    geometry->baseVertex = (WorldInt *) malloc(cnt * sizeof(WorldInt));
+    geometry->batches = (WorldBatch *) malloc(cnt * sizeof(WorldBatch));
+    geometry->batchCnt = 0;
+
+    for (i = 0; i < cnt; ++i)
+    {
+        const WorldObject * obj = world->queue[i];
+        WorldVertexFormat format =
+            getObjectVertexFormat(obj, geometry->format);
+        WorldBatch * batch = getWorldBatch(geometry, obj, format, i);
+
+        batch->idxCnt[batch->drawCnt] = obj->idxCnt;
+        batch->idxOffset[batch->drawCnt] =
+            (const void *) (idxCnt * sizeof(WorldUint));
+        batch->baseVertex[batch->drawCnt] = vertexCnt[format];
+        ++(batch->drawCnt);
+
+        vertexCnt[format] += obj->cnt;
+        idxCnt += obj->idxCnt;
+    }
+
+    geometry->floatVertexOffset = vertexCnt[WORLD_VERTEX_PACKED] *
+        getWorldVertexSize(WORLD_VERTEX_PACKED);
+    geometry->vertexBytes = geometry->floatVertexOffset +
+        vertexCnt[WORLD_VERTEX_FLOAT] *
+        getWorldVertexSize(WORLD_VERTEX_FLOAT);
+    geometry->idxBytes = idxCnt * sizeof(WorldUint);
+}
+
+void freeWorldBatches(WorldGeometry * geometry)
+{
+    free(geometry->idxCnt);
+    free(geometry->idxOffset);
+    free(geometry->baseVertex);
+    free(geometry->batches);
+}
+
+void packWorldVertices(const World * world, void * dst)
+{
+    const WorldGeometry * geometry = &(world->geometry);
+    char * cur[WORLD_VERTEX_FORMATS_CNT];
+    int i;
+
+    cur[WORLD_VERTEX_PACKED] = (char *) dst;
+    cur[WORLD_VERTEX_FLOAT] = (char *) dst + geometry->floatVertexOffset;
+
+    for (i = 0; i < world->objList.cnt; ++i)
+    {
+        const WorldObject * obj = world->queue[i];
+        WorldVertexFormat format =
+            getObjectVertexFormat(obj, geometry->format);
+
+        packVertices(cur[format], format, obj);
+        cur[format] += obj->cnt * getWorldVertexSize(format);
+    }
+}
+
+void packWorldIndices(const World * world, WorldUint * dst)
+{
+    int i;
+
+    for (i = 0; i < world->objList.cnt; ++i)
+    {
+        const WorldObject * obj = world->queue[i];
+
+        memcpy(dst, obj->idx, obj->idxCnt * sizeof(WorldUint));
+        dst += obj->idxCnt;
+    }
+}
+
+int isWorldIdxPacked(const World * world, const WorldUint * idx)
+{
+    int i;
+
+    for (i = 0; i < world->objList.cnt; ++i)
+    {
+        const WorldObject * obj = world->queue[i];
+
+        if (memcmp(idx, obj->idx, obj->idxCnt * sizeof(WorldUint)) != 0)
+        {
+            return 0;
+        }
+
+        idx += obj->idxCnt;
+    }
+
+    return 1;
+}
@@ -0,0 +1,53 @@
+#ifndef WORLD_PACK_H_SENTRY
+#define WORLD_PACK_H_SENTRY
+
+#include "world_data.h"
+
+/* CPU side of world geometry: render queue, batches and vertex formats.
+ * No OpenGL calls, so compiled world is built by WaveTool with the same
+ * code. */
+
+typedef
+struct FloatVertex
+{
+    WorldFloat position[3];
+    WorldFloat normal[3];
+    WorldFloat texCoord[2];
+}
+FloatVertex;
+
+/* Normal is GL_INT_2_10_10_10_REV, texture coordinates are half
+ * floats. */
+typedef
+struct PackedVertex
+{
+    WorldFloat position[3];
+    WorldUint normal;
+    WorldHalf texCoord[2];
+}
+PackedVertex;
+
+WorldInt getWorldVertexSize(WorldVertexFormat format);
+
+/* Numbers textures of materials (in order of materials, by file name)
+ * and sorts objects into render queue. */
+void setupRenderQueue(World * world);
+
+/* Per object draw arrays, batches and buffer sizes of world->geometry
+ * for its format, by render queue. */
+void setupWorldBatches(World * world);
+
+/* Frees what setupWorldBatches() allocated. */
+void freeWorldBatches(WorldGeometry * geometry);
+
+/* Writes vertices (geometry->vertexBytes) of render queue in format of
+ * geometry, float ones of packed geometry after packed ones. */
+void packWorldVertices(const World * world, void * dst);
+
+/* Writes indices (geometry->idxBytes) of render queue. */
+void packWorldIndices(const World * world, WorldUint * dst);
+
+/* 1 if idx (geometry->idxBytes) is what packWorldIndices() writes. */
+int isWorldIdxPacked(const World * world, const WorldUint * idx);
+
+#endif /* WORLD_PACK_H_SENTRY */
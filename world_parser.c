@@ -0,0 +1,1299 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <setjmp.h>
+#include "world_parser.h"
+#include "world_lexer.h"
+#include "float_scan.h"
+#include "world_binary.h"
+#include "utils.h"
+#include "mesh.h"
+#include "thread_pool.h"
+
+typedef
+enum BlockType
+{
+    BLOCK_UNKNOWN,
+    BLOCK_EOF,
+    BLOCK_POINT_LIGHT,
+    BLOCK_MATERIAL,
+    BLOCK_SQUARE,
+    BLOCK_HORIZ_MESH,
+    BLOCK_CUBE,
+    BLOCK_OPEN_CUBE
+}
+BlockType;
+
+static const char * blockTypeStr[] =
+{
+    "", /* BLOCK_UNKNOWN */
+    "", /* BLOCK_EOF */
+    "PointLight",
+    "Material",
+    "Square",
+    "HorizMesh",
+    "Cube",
+    "OpenCube"
+};
+
+#define BLOCK_TYPES_CNT (sizeof(blockTypeStr) / sizeof(const char *))
+
+typedef
+enum AttributeType
+{
+    ATTR_UNKNOWN,
+    ATTR_GLFLOAT,
+    ATTR_VEC2,
+    ATTR_VEC3,
+    ATTR_VEC4,
+    ATTR_GLINT,
+    ATTR_STRING
+}
+AttributeType;
+
+static const char * attrTypeStr[] =
+{
+    "",
+    "GLfloat",
+    "vec2",
+    "vec3",
+    "vec4",
+    "GLint",
+    "string"
+};
+
+#define ATTR_TYPES_CNT (sizeof(attrTypeStr) / sizeof(const char *))
+
+typedef
+union AttributeValue
+{
+    WorldInt v_int;
+    WorldFloat v_float;
+    /* Owned by attribute list till taken by takeAttributeValue(). */
+    WorldFloat * v_vector;
+    /* Interned. */
+    const char * v_string;
+}
+AttributeValue;
+
+typedef
+struct Attribute
+{
+    struct Attribute * next;
+
+    AttributeType type;
+    /* Interned, token is for errors. */
+    const char * name;
+    WorldToken nameToken;
+    AttributeValue value;
+    WorldInt cnt;
+}
+Attribute;
+
+typedef
+struct AttributeList
+{
+    Attribute * first;
+    Attribute * last;
+
+    /* Attributes by name. */
+    NameIndex index;
+
+    /* For errors: lexer and "{" of the block. */
+    const WorldLexer * lexer;
+    WorldToken start;
+}
+AttributeList;
+
+/* ---- Functions ---- */
+
+static void die(const char * fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+
+    exit(EXIT_FAILURE);
+}
+
+int getInt(WorldLexer * lexer)
+{
+    WorldToken token;
+    char * endp;
+    long int value;
+
+    getTokenNotEof(lexer, &token);
+
+    errno = 0;
+
+    value = strtol(token.str, &endp, 10);
+
+    if (errno != 0 || endp != token.str + token.length ||
+        value < INT_MIN || value > INT_MAX)
+    {
+        worldLexerError(lexer, &token, "\"%.*s\" is not GLint.\n",
+            token.length, token.str);
+    }
+
+    return (int) value;
+}
+
+static void scanNextFloat(WorldLexer * lexer, WorldFloat * f)
+{
+    WorldToken token;
+
+    getTokenNotEof(lexer, &token);
+
+    if (! scanFloat(token.str, token.length, f))
+    {
+        worldLexerError(lexer, &token, "\"%.*s\" is not GLfloat.\n",
+            token.length, token.str);
+    }
+}
+
+WorldFloat getFloat(WorldLexer * lexer)
+{
+    WorldFloat f;
+
+    scanNextFloat(lexer, &f);
+
+    return f;
+}
+
+/* Block "{ ... }" of cnt vectors of size components. Numbers are
+ * scanned from text of lexer straight into the vector. */
+WorldFloat * getVector(WorldLexer * lexer, int size, WorldInt cnt)
+{
+    WorldFloat * vector = (WorldFloat *) malloc(cnt * size * sizeof(WorldFloat));
+    WorldFloat * cur = vector;
+    WorldFloat * end = vector + cnt * size;
+
+    checkNextLex(lexer, "{");
+
+    for (; cur < end; ++cur)
+    {
+        scanNextFloat(lexer, cur);
+    }
+
+    checkNextLex(lexer, "}");
+
+    return vector;
+}
+
+const char * getString(WorldLexer * lexer)
+{
+    WorldToken token;
+
+    checkNextLex(lexer, "\"");
+
+    getTokenNotEof(lexer, &token);
+
+    checkNextLex(lexer, "\"");
+
+    return internToken(lexer, &token);
+}
+
+AttributeType getAttributeType(WorldLexer * lexer, const WorldToken * token)
+{
+    unsigned int i;
+
+    for (i = 1; i < ATTR_TYPES_CNT; ++i)
+    {
+        if (isToken(token, attrTypeStr[i]))
+        {
+            return (AttributeType) i;
+        }
+    }
+
+    worldLexerError(lexer, token, "unknown attribute type \"%.*s\".\n",
+        token->length, token->str);
+
+    /* Not possible */
+    return ATTR_UNKNOWN;
+}
+
+Attribute * getAttribute(WorldLexer * lexer)
+{
+    Attribute * attr;
+    WorldToken token;
+
+    getTokenNotEof(lexer, &token);
+
+    if (isToken(&token, "}"))
+    {
+        return NULL;
+    }
+
+    attr = (Attribute *) malloc(sizeof(Attribute));
+
+    attr->next = NULL;
+    attr->type = getAttributeType(lexer, &token);
+    getTokenNotEof(lexer, &(attr->nameToken));
+    attr->name = internToken(lexer, &(attr->nameToken));
+
+    getTokenNotEof(lexer, &token);
+
+    if (isToken(&token, "="))
+    {
+        attr->cnt = 1;
+    }
+    else if (isToken(&token, "["))
+    {
+        attr->cnt = getInt(lexer);
+        checkNextLex(lexer, "]");
+        checkNextLex(lexer, "=");
+    }
+    else
+    {
+        worldLexerError(lexer, &token, "\"%.*s\" is not \"=\" or \"[\".\n",
+            token.length, token.str);
+    }
+
+    switch (attr->type)
+    {
+        case ATTR_UNKNOWN:
+            /* Not possible */
+            break;
+        case ATTR_GLFLOAT:
+            attr->value.v_float = getFloat(lexer);
+            break;
+        case ATTR_VEC2:
+            attr->value.v_vector = getVector(lexer, 2, attr->cnt);
+            break;
+        case ATTR_VEC3:
+            attr->value.v_vector = getVector(lexer, 3, attr->cnt);
+            break;
+        case ATTR_VEC4:
+            attr->value.v_vector = getVector(lexer, 4, attr->cnt);
+            break;
+        case ATTR_GLINT:
+            attr->value.v_int = getInt(lexer);
+            break;
+        case ATTR_STRING:
+            attr->value.v_string = getString(lexer);
+            break;
+    }
+
+    return attr;
+}
+
+AttributeValue getAttributeValue(const AttributeList * list,
+    AttributeType type, const char * name, WorldInt cnt)
+{
+    Attribute * attr = (Attribute *) getFromNameIndex(&(list->index), name);
+
+    if (attr == NULL || attr->type != type || attr->cnt != cnt)
+    {
+        worldLexerError(list->lexer, &(list->start),
+            "attribute \"%s\" not found in block.\n", name);
+    }
+
+    return attr->value;
+}
+
+/* Vector of the attribute is not freed with the list, caller owns it. */
+AttributeValue takeAttributeValue(AttributeList * list,
+    AttributeType type, const char * name, WorldInt cnt)
+{
+    AttributeValue v = getAttributeValue(list, type, name, cnt);
+    Attribute * attr = (Attribute *) getFromNameIndex(&(list->index), name);
+
+    attr->value.v_vector = NULL;
+
+    return v;
+}
+
+AttributeList * getAttributeList(WorldLexer * lexer)
+{
+    AttributeList * list = (AttributeList *) malloc(sizeof(AttributeList));
+
+    list->first = NULL;
+    list->last = NULL;
+    initNameIndex(&(list->index));
+    list->lexer = lexer;
+
+    getTokenNotEof(lexer, &(list->start));
+
+    if (! isToken(&(list->start), "{"))
+    {
+        worldLexerError(lexer, &(list->start), "\"%.*s\" is not \"{\".\n",
+            list->start.length, list->start.str);
+    }
+
+    do
+    {
+        Attribute * attr = getAttribute(lexer);
+
+        if (attr == NULL)
+        {
+            return list;
+        }
+
+        if (addToNameIndex(&(list->index), attr->name, attr) != NULL)
+        {
+            worldLexerError(lexer, &(attr->nameToken),
+                "repeated attribute \"%s\".\n", attr->name);
+        }
+
+        if (list->last == NULL)
+        {
+            list->first = list->last = attr;
+        }
+        else
+        {
+            list->last = list->last->next = attr;
+        }
+    }
+    while(1);
+
+    return list;
+}
+
+/* Frees vectors, which are not taken. Strings are interned, they are
+ * freed with the world. */
+void freeAttributeList(AttributeList * list)
+{
+    Attribute * cur = list->first;
+    Attribute * next = NULL;
+
+    while (cur != NULL)
+    {
+        next = cur->next;
+
+        if (cur->type == ATTR_VEC2 || cur->type == ATTR_VEC3 ||
+            cur->type == ATTR_VEC4)
+        {
+            free(cur->value.v_vector);
+        }
+
+        free(cur);
+        cur = next;
+    }
+
+    freeNameIndex(&(list->index));
+    free(list);
+}
+
+void copyVec3(WorldFloat * dst, const WorldFloat * src)
+{
+    if (src == NULL)
+    {
+        die("copyVec3() failed.\n");
+    }
+
+    dst[0] = src[0];
+    dst[1] = src[1];
+    dst[2] = src[2];
+}
+
+void copyVec4(WorldFloat * dst, const WorldFloat * src)
+{
+    if (src == NULL)
+    {
+        die("copyVec4() failed.\n");
+    }
+
+    dst[0] = src[0];
+    dst[1] = src[1];
+    dst[2] = src[2];
+    dst[3] = src[3];
+}
+
+PointLight * getPointLight(WorldLexer * lexer)
+{
+    PointLight * pointLight = (PointLight *) malloc(sizeof(PointLight));
+    AttributeList * list = getAttributeList(lexer);
+    AttributeValue v;
+
+    v = getAttributeValue(list, ATTR_VEC3, "position", 1);
+    copyVec3(pointLight->position, v.v_vector);
+
+    v = getAttributeValue(list, ATTR_VEC4, "ambient", 1);
+    copyVec4(pointLight->ambient, v.v_vector);
+
+    v = getAttributeValue(list, ATTR_VEC4, "diffuse", 1);
+    copyVec4(pointLight->diffuse, v.v_vector);
+
+    v = getAttributeValue(list, ATTR_VEC4, "specular", 1);
+    copyVec4(pointLight->specular, v.v_vector);
+
+    v = getAttributeValue(list, ATTR_VEC3, "attenuation", 1);
+    copyVec3(pointLight->attenuation, v.v_vector);
+
+    freeAttributeList(list);
+
+    return pointLight;
+}
+
+Material * getMaterial(WorldLexer * lexer)
+{
+    Material * material = (Material *) malloc(sizeof(Material));
+    AttributeList * list;
+    AttributeValue v;
+    WorldToken token;
+
+    material->next = NULL;
+
+    getTokenNotEof(lexer, &token);
+    material->name = internToken(lexer, &token);
+
+    list = getAttributeList(lexer);
+
+    v = getAttributeValue(list, ATTR_STRING, "texture", 1);
+    material->textureName = v.v_string;
+    material->texture = NULL;
+
+    v = getAttributeValue(list, ATTR_VEC4, "emission", 1);
+    copyVec4(material->emission, v.v_vector);
+
+    v = getAttributeValue(list, ATTR_VEC4, "ambient", 1);
+    copyVec4(material->ambient, v.v_vector);
+
+    v = getAttributeValue(list, ATTR_VEC4, "diffuse", 1);
+    copyVec4(material->diffuse, v.v_vector);
+
+    v = getAttributeValue(list, ATTR_VEC4, "specular", 1);
+    copyVec4(material->specular, v.v_vector);
+
+    v = getAttributeValue(list, ATTR_GLFLOAT, "shininess", 1);
+    material->shininess = v.v_float;
+
+    freeAttributeList(list);
+
+    return material;
+}
+
+WorldFloat * repeatArrayElem(WorldFloat * arr, int size, WorldInt cnt, int times)
+{
+    WorldFloat * res = (WorldFloat *) malloc(cnt * times * size * sizeof(WorldFloat));
+    int i, j, k;
+
+    for (i = 0; i < cnt; ++i)
+    {
+        for (j = 0; j < times; ++j)
+        {
+            for (k = 0; k < size; ++k)
+            {
+                int idx = i * times * size + j * size + k;
+                res[idx] = arr[i * size + k];
+            }
+        }
+    }
+
+    return res;
+}
+
+WorldFloat * concatArrays(const WorldFloat * arr1, const WorldFloat * arr2,
+    WorldInt cnt1, WorldInt cnt2)
+{
+    WorldInt size1 = cnt1 * sizeof(WorldFloat);
+    WorldInt size2 = cnt2 * sizeof(WorldFloat);
+
+    WorldFloat * res = (WorldFloat *) malloc(size1 + size2);
+
+    memcpy(res, arr1, size1); 
+    memcpy(res + cnt1, arr2, size2); 
+
+    return res;
+}
+
+WorldObject * getSquare(WorldLexer * lexer)
+{
+    WorldObject * obj = (WorldObject *) malloc (sizeof(WorldObject));
+    AttributeList * list = getAttributeList(lexer);
+    AttributeValue v;
+    int i;
+
+    obj->next = NULL;
+
+    v = getAttributeValue(list, ATTR_STRING, "material", 1);
+    obj->materialName = v.v_string;
+
+    obj->primitiveType = WORLD_TRIANGLES;
+    obj->cnt = 4;
+
+    v = takeAttributeValue(list, ATTR_VEC3, "corners", obj->cnt);
+    obj->position = v.v_vector;
+
+    v = getAttributeValue(list, ATTR_VEC3, "normal", 1);
+    obj->normal = repeatArrayElem(v.v_vector, 3, 1, obj->cnt);
+
+    v = takeAttributeValue(list, ATTR_VEC2, "texture_coords", obj->cnt);
+    obj->texCoord = v.v_vector;
+
+    obj->idxCnt = 6;
+    obj->idx = (WorldUint *) malloc(obj->idxCnt * sizeof(WorldUint));
+
+    for (i = 0; i < 3; ++i)
+    {
+        obj->idx[i] = i;
+    }
+
+    for (i = 3; i < 6; ++i)
+    {
+        obj->idx[i] = i - 2;
+    }
+
+    freeAttributeList(list);
+
+    return obj;
+}
+
+WorldObject * getHorizMesh(WorldLexer * lexer)
+{
+    WorldObject * obj = (WorldObject *) malloc (sizeof(WorldObject));
+    AttributeList * list = getAttributeList(lexer);
+    AttributeValue v;
+    MeshData data;
+    int x, y;
+
+    obj->next = NULL;
+
+    v = getAttributeValue(list, ATTR_STRING, "material", 1);
+    obj->materialName = v.v_string;
+
+    obj->primitiveType = WORLD_TRIANGLES;
+
+    v = getAttributeValue(list, ATTR_GLINT, "w", 1);
+    data.w = v.v_int;
+
+    v = getAttributeValue(list, ATTR_GLINT, "h", 1);
+    data.h = v.v_int;
+
+    obj->cnt = data.w * data.h;
+
+    v = getAttributeValue(list, ATTR_GLFLOAT, "firstX", 1);
+    data.firstX = v.v_float;
+
+    v = getAttributeValue(list, ATTR_GLFLOAT, "lastX", 1);
+    data.lastX = v.v_float;
+
+    v = getAttributeValue(list, ATTR_GLFLOAT, "firstY", 1);
+    data.firstY = v.v_float;
+
+    v = getAttributeValue(list, ATTR_GLFLOAT, "lastY", 1);
+    data.lastY = v.v_float;
+
+    v = getAttributeValue(list, ATTR_GLFLOAT, "z", 1);
+    data.z = v.v_float;
+
+    obj->position = meshGenVertices(&data);
+    obj->idxCnt = meshGenIdx(&data, &(obj->idx));
+
+    v = getAttributeValue(list, ATTR_VEC3, "normal", 1);
+    obj->normal = repeatArrayElem(v.v_vector, 3, 1, obj->cnt);
+
+    v = getAttributeValue(list, ATTR_VEC2, "texture_coords_from_to", 2);
+    obj->texCoord = (WorldFloat *) malloc(obj->cnt * 2 * sizeof(WorldFloat));
+
+    for (y = 0; y < data.w; ++y)
+    {
+        for (x = 0; x < data.h; ++x)
+        {
+            obj->texCoord[2 * (y * data.w + x) + 0] =
+                (v.v_vector)[0] + ((v.v_vector)[2] - v.v_vector[0]) *
+                x / (data.w - 1);
+            obj->texCoord[2 * (y * data.w + x) + 1] =
+                (v.v_vector)[1] + ((v.v_vector)[3] - v.v_vector[1]) *
+                y / (data.h - 1);
+        }
+    }
+
+    freeAttributeList(list);
+
+    return obj;
+}
+
+WorldFloat * getOpenCubePosition(WorldFloat * top, WorldFloat * bottom)
+{
+    WorldFloat * position = (WorldFloat *) malloc(20 * 3 * sizeof(WorldFloat));
+
+    /* bottom */
+    copyVec3(position + 3 * 0, bottom + 3 * 0);
+    copyVec3(position + 3 * 1, bottom + 3 * 1);
+    copyVec3(position + 3 * 2, bottom + 3 * 2);
+    copyVec3(position + 3 * 3, bottom + 3 * 3);
+
+    /* left */
+    copyVec3(position + 3 * 4, top + 3 * 0);
+    copyVec3(position + 3 * 5, top + 3 * 1);
+    copyVec3(position + 3 * 6, bottom + 3 * 0);
+    copyVec3(position + 3 * 7, bottom + 3 * 1);
+
+    /* right */
+    copyVec3(position + 3 *  8, top + 3 * 2);
+    copyVec3(position + 3 *  9, top + 3 * 3);
+    copyVec3(position + 3 * 10, bottom + 3 * 2);
+    copyVec3(position + 3 * 11, bottom + 3 * 3);
+
+    /* back */
+    copyVec3(position + 3 * 12, top + 3 * 1);
+    copyVec3(position + 3 * 13, top + 3 * 3);
+    copyVec3(position + 3 * 14, bottom + 3 * 1);
+    copyVec3(position + 3 * 15, bottom + 3 * 3);
+
+    /* forward */
+    copyVec3(position + 3 * 16, top + 3 * 0);
+    copyVec3(position + 3 * 17, top + 3 * 2);
+    copyVec3(position + 3 * 18, bottom + 3 * 0);
+    copyVec3(position + 3 * 19, bottom + 3 * 2);
+
+    return position;
+}
+
+WorldFloat * getCubePosition(WorldFloat * top, WorldFloat * bottom)
+{
+    WorldFloat * position = (WorldFloat *) malloc(24 * 3 * sizeof(WorldFloat));
+
+    /* top */
+    copyVec3(position + 3 * 0, top + 3 * 0);
+    copyVec3(position + 3 * 1, top + 3 * 1);
+    copyVec3(position + 3 * 2, top + 3 * 2);
+    copyVec3(position + 3 * 3, top + 3 * 3);
+
+
+    /* bottom */
+    copyVec3(position + 3 * 4, bottom + 3 * 0);
+    copyVec3(position + 3 * 5, bottom + 3 * 1);
+    copyVec3(position + 3 * 6, bottom + 3 * 2);
+    copyVec3(position + 3 * 7, bottom + 3 * 3);
+
+    /* left */
+    copyVec3(position + 3 *  8, top + 3 * 0);
+    copyVec3(position + 3 *  9, top + 3 * 1);
+    copyVec3(position + 3 * 10, bottom + 3 * 0);
+    copyVec3(position + 3 * 11, bottom + 3 * 1);
+
+    /* right */
+    copyVec3(position + 3 * 12, top + 3 * 2);
+    copyVec3(position + 3 * 13, top + 3 * 3);
+    copyVec3(position + 3 * 14, bottom + 3 * 2);
+    copyVec3(position + 3 * 15, bottom + 3 * 3);
+
+    /* back */
+    copyVec3(position + 3 * 16, top + 3 * 1);
+    copyVec3(position + 3 * 17, top + 3 * 3);
+    copyVec3(position + 3 * 18, bottom + 3 * 1);
+    copyVec3(position + 3 * 19, bottom + 3 * 3);
+
+    /* forward */
+    copyVec3(position + 3 * 20, top + 3 * 0);
+    copyVec3(position + 3 * 21, top + 3 * 2);
+    copyVec3(position + 3 * 22, bottom + 3 * 0);
+    copyVec3(position + 3 * 23, bottom + 3 * 2);
+
+    return position;
+}
+
+WorldFloat * getOpenCubeTexCoord(const AttributeList * list)
+{
+    AttributeValue v;
+    WorldFloat * bottomCoord;
+    WorldFloat * edgeCoord;
+    WorldFloat * res;
+
+    v = getAttributeValue(list, ATTR_VEC2, "texture_coords_bottom", 4);
+    bottomCoord = v.v_vector;
+
+    v = getAttributeValue(list, ATTR_VEC2, "texture_coords", 4);
+    edgeCoord = repeatArrayElem(v.v_vector, 8, 1, 4);
+
+    res = concatArrays(bottomCoord, edgeCoord, 8, 32);
+
+    free(edgeCoord);
+
+    return res;
+}
+
+WorldFloat * getCubeTexCoord(const AttributeList * list)
+{
+    AttributeValue v;
+
+    v = getAttributeValue(list, ATTR_VEC2, "texture_coords", 4);
+    return repeatArrayElem(v.v_vector, 8, 1, 6);
+}
+
+
+WorldObject * getOpenCube(WorldLexer * lexer)
+{
+    WorldObject * obj = (WorldObject *) malloc (sizeof(WorldObject));
+    AttributeList * list = getAttributeList(lexer);
+    WorldFloat * top;
+    WorldFloat * bottom;
+    AttributeValue v;
+    int i;
+
+    obj->next = NULL;
+
+    v = getAttributeValue(list, ATTR_STRING, "material", 1);
+    obj->materialName = v.v_string;
+
+    obj->primitiveType = WORLD_TRIANGLES;
+    obj->cnt = 20;
+
+    v = getAttributeValue(list, ATTR_VEC3, "top", 4);
+    top = v.v_vector;
+
+    v = getAttributeValue(list, ATTR_VEC3, "bottom", 4);
+    bottom = v.v_vector;
+
+    obj->position = getOpenCubePosition(top, bottom);
+
+    v = getAttributeValue(list, ATTR_VEC3, "normal", 5);
+    obj->normal = repeatArrayElem(v.v_vector, 3, 5, 4);
+
+    obj->texCoord = getOpenCubeTexCoord(list);
+
+    obj->idxCnt = 30;
+    obj->idx = (WorldUint *) malloc(obj->idxCnt * sizeof(WorldUint));
+
+    for (i = 0; i < 3; ++i)
+    {
+        obj->idx[i] = i;
+    }
+
+    for (i = 3; i < 6; ++i)
+    {
+        obj->idx[i] = i - 2;
+    }
+
+    for (i = 6; i < obj->idxCnt; ++i)
+    {
+        obj->idx[i] = obj->idx[i % 6] + 4 * (i / 6);
+    }
+
+    freeAttributeList(list);
+
+    return obj;
+}
+
+WorldObject * getCube(WorldLexer * lexer)
+{
+    WorldObject * obj = (WorldObject *) malloc (sizeof(WorldObject));
+    AttributeList * list = getAttributeList(lexer);
+    WorldFloat * top;
+    WorldFloat * bottom;
+    AttributeValue v;
+    int i;
+
+    obj->next = NULL;
+
+    v = getAttributeValue(list, ATTR_STRING, "material", 1);
+    obj->materialName = v.v_string;
+
+    obj->primitiveType = WORLD_TRIANGLES;
+    obj->cnt = 24;
+
+    v = getAttributeValue(list, ATTR_VEC3, "top", 4);
+    top = v.v_vector;
+
+    v = getAttributeValue(list, ATTR_VEC3, "bottom", 4);
+    bottom = v.v_vector;
+
+    obj->position = getCubePosition(top, bottom);
+
+    v = getAttributeValue(list, ATTR_VEC3, "normal", 6);
+    obj->normal = repeatArrayElem(v.v_vector, 3, 6, 4);
+
+    obj->texCoord = getCubeTexCoord(list);
+
+    obj->idxCnt = 36;
+    obj->idx = (WorldUint *) malloc(obj->idxCnt * sizeof(WorldUint));
+
+    for (i = 0; i < 3; ++i)
+    {
+        obj->idx[i] = i;
+    }
+
+    for (i = 3; i < 6; ++i)
+    {
+        obj->idx[i] = i - 2;
+    }
+
+    for (i = 6; i < obj->idxCnt; ++i)
+    {
+        obj->idx[i] = obj->idx[i % 6] + 4 * (i / 6);
+    }
+
+    freeAttributeList(list);
+
+    return obj;
+}
+
+void addPointLight(PointLight ** pointLightP, PointLight * pointLight)
+{
+    if (*pointLightP == NULL)
+    {
+        *pointLightP = pointLight;
+    }
+    else
+    {
+        die("Supported only one point light.\n");
+    }
+}
+
+void addMaterial(MaterialList * list, Material * material)
+{
+    if (addToNameIndex(&(list->index), material->name, material) != NULL)
+    {
+        die("Repeated material \"%s\".\n", material->name);
+    }
+
+    material->num = (list->cnt)++;
+
+    if (list->last == NULL)
+    {
+        list->first = list->last = material;
+    }
+    else
+    {
+        list->last = list->last->next = material;
+    }
+}
+
+void addWorldObject(WorldObjectList * list, WorldObject * object)
+{
+    object->num = (list->cnt)++;
+
+    if (list->last == NULL)
+    {
+        list->first = list->last = object;
+    }
+    else
+    {
+        list->last = list->last->next = object;
+    }
+}
+
+BlockType getBlockType(const WorldToken * token)
+{
+    unsigned int i;
+
+    for (i = 1; i < BLOCK_TYPES_CNT; ++i)
+    {
+        if (isToken(token, blockTypeStr[i]))
+        {
+            return (BlockType) i;
+        }
+    }
+
+    return BLOCK_UNKNOWN;
+}
+
+/* Once at load time, objects keep material pointers. */
+void resolveObjectMaterials(World * world)
+{
+    WorldObject * cur;
+
+    for (cur = world->objList.first; cur != NULL; cur = cur->next)
+    {
+        cur->material = (Material *)
+            getFromNameIndex(&(world->mtrlList.index), cur->materialName);
+
+        if (cur->material == NULL)
+        {
+            die("Material \"%s\" not found.\n", cur->materialName);
+        }
+    }
+}
+
+World * newParsedWorld(void)
+{
+    World * world = (World *) malloc(sizeof(World));
+
+    world->names = newStringTable();
+    world->binary = NULL;
+
+    world->pointLight = NULL;
+    world->mtrlList.first = NULL;
+    world->mtrlList.last = NULL;
+    world->mtrlList.cnt = 0;
+    initNameIndex(&(world->mtrlList.index));
+    world->objList.first = NULL;
+    world->objList.last = NULL;
+    world->objList.cnt = 0;
+    world->texList.first = NULL;
+    world->texList.last = NULL;
+    world->texList.cnt = 0;
+    initNameIndex(&(world->texList.index));
+
+    return world;
+}
+
+static void * parseBlock(WorldLexer * lexer, BlockType type)
+{
+    switch (type)
+    {
+        case BLOCK_POINT_LIGHT:
+            return getPointLight(lexer);
+        case BLOCK_MATERIAL:
+            return getMaterial(lexer);
+        case BLOCK_SQUARE:
+            return getSquare(lexer);
+        case BLOCK_HORIZ_MESH:
+            return getHorizMesh(lexer);
+        case BLOCK_CUBE:
+            return getCube(lexer);
+        case BLOCK_OPEN_CUBE:
+            return getOpenCube(lexer);
+        default:
+            /* Not possible */
+            return NULL;
+    }
+}
+
+static void addBlock(World * world, BlockType type, void * result)
+{
+    switch (type)
+    {
+        case BLOCK_POINT_LIGHT:
+            addPointLight(&(world->pointLight), (PointLight *) result);
+            break;
+        case BLOCK_MATERIAL:
+            addMaterial(&(world->mtrlList), (Material *) result);
+            break;
+        case BLOCK_SQUARE:
+        case BLOCK_HORIZ_MESH:
+        case BLOCK_CUBE:
+        case BLOCK_OPEN_CUBE:
+            addWorldObject(&(world->objList), (WorldObject *) result);
+            break;
+        default:
+            /* Not possible */
+            break;
+    }
+}
+
+/* Result of block, which is not added to world. */
+static void freeBlock(BlockType type, void * result)
+{
+    WorldObject * obj = (WorldObject *) result;
+
+    switch (type)
+    {
+        case BLOCK_POINT_LIGHT:
+        case BLOCK_MATERIAL:
+            free(result);
+            break;
+        case BLOCK_SQUARE:
+        case BLOCK_HORIZ_MESH:
+        case BLOCK_CUBE:
+        case BLOCK_OPEN_CUBE:
+            free(obj->position);
+            free(obj->normal);
+            free(obj->texCoord);
+            free(obj->idx);
+            free(obj);
+            break;
+        default:
+            /* Not possible */
+            break;
+    }
+}
+
+static void parseWorldBlocks(World * world, WorldLexer * lexer)
+{
+    WorldToken token;
+
+    while (getToken(lexer, &token))
+    {
+        BlockType type = getBlockType(&token);
+
+        if (type == BLOCK_UNKNOWN)
+        {
+            worldLexerError(lexer, &token, "unknown block type \"%.*s\".\n",
+                token.length, token.str);
+        }
+
+        addBlock(world, type, parseBlock(lexer, type));
+    }
+}
+
+/* ---- Parallel parsing ---- */
+
+/* Less blocks are parsed by one thread. */
+#define WORLD_PARALLEL_BLOCKS_MIN 256
+
+/* Tasks for each thread, for balance of work stealing. */
+#define WORLD_TASKS_PER_THREAD 8
+
+typedef
+struct WorldBlock
+{
+    BlockType type;
+
+    /* Block type token, and end of the block found by pre-scan. */
+    const char * start;
+    const char * end;
+
+    /* NULL, if the block is not parsed. */
+    void * result;
+
+    /* Set by the task of the block, if parser found an error in it or
+     * ended it not where pre-scan did. */
+    int mismatch;
+}
+WorldBlock;
+
+typedef
+struct WorldBlockList
+{
+    WorldBlock * blocks;
+    int cnt;
+
+    const WorldLexer * lexer;
+
+    /* Names of each task, merged in world in file order. */
+    StringTable ** names;
+    int taskCnt;
+}
+WorldBlockList;
+
+/* Pre-scan: top-level blocks of lexer text. Returns 0, if text is not
+ * well-formed at top level, then it is parsed by one thread, which
+ * reports the first error as usual. */
+static int scanWorldBlocks(WorldLexer * lexer, WorldBlockList * list)
+{
+    int capacity = 1024;
+    WorldToken token;
+
+    list->blocks = (WorldBlock *) malloc(capacity * sizeof(WorldBlock));
+    list->cnt = 0;
+
+    while (getToken(lexer, &token))
+    {
+        WorldBlock * block;
+
+        if (list->cnt == capacity)
+        {
+            capacity *= 2;
+            list->blocks = (WorldBlock *)
+                realloc(list->blocks, capacity * sizeof(WorldBlock));
+        }
+
+        block = list->blocks + (list->cnt)++;
+        block->type = getBlockType(&token);
+        block->start = token.str;
+        block->result = NULL;
+        block->mismatch = 0;
+
+        /* Material has name before "{". */
+        if (block->type == BLOCK_UNKNOWN ||
+            (block->type == BLOCK_MATERIAL && ! getToken(lexer, &token)) ||
+            ! skipBlock(lexer))
+        {
+            return 0;
+        }
+
+        block->end = lexer->pos;
+    }
+
+    return 1;
+}
+
+/* Task is range of blocks, it has own lexer and names. Error in a block
+ * stops the task: exit() is not for worker threads, and the first error
+ * in file order is reported by one thread later. What the failed block
+ * allocated is lost, but the program exits there anyway. */
+static void parseWorldBlocksTask(void * arg, int taskIdx)
+{
+    WorldBlockList * list = (WorldBlockList *) arg;
+    int first = (int) ((long) list->cnt * taskIdx / list->taskCnt);
+    int last = (int) ((long) list->cnt * (taskIdx + 1) / list->taskCnt);
+    WorldLexer lexer = *(list->lexer);
+    jmp_buf errorJump;
+    int i;
+
+    list->names[taskIdx] = newStringTable();
+    lexer.names = list->names[taskIdx];
+    lexer.errorJump = &errorJump;
+
+    if (setjmp(errorJump) != 0)
+    {
+        return;
+    }
+
+    for (i = first; i < last; ++i)
+    {
+        WorldBlock * block = list->blocks + i;
+        WorldToken token;
+
+        /* Until the block is parsed. */
+        block->mismatch = 1;
+
+        lexer.pos = block->start;
+        getTokenNotEof(&lexer, &token);
+
+        block->result = parseBlock(&lexer, block->type);
+        block->mismatch = (lexer.pos != block->end);
+    }
+}
+
+static const char * reinternName(World * world, const char * name)
+{
+    return internString(world->names, name, strlen(name));
+}
+
+/* Adds parsed blocks in file order, names go to world table. */
+static void mergeWorldBlocks(World * world, WorldBlockList * list)
+{
+    int i;
+
+    for (i = 0; i < list->cnt; ++i)
+    {
+        WorldBlock * block = list->blocks + i;
+
+        if (block->type == BLOCK_MATERIAL)
+        {
+            Material * material = (Material *) block->result;
+
+            material->name = reinternName(world, material->name);
+            material->textureName = reinternName(world,
+                material->textureName);
+        }
+        else if (block->type != BLOCK_POINT_LIGHT)
+        {
+            WorldObject * obj = (WorldObject *) block->result;
+
+            obj->materialName = reinternName(world, obj->materialName);
+        }
+
+        addBlock(world, block->type, block->result);
+    }
+}
+
+/* Returns 0, if blocks should be parsed by one thread. */
+static int parseWorldBlocksParallel(World * world, WorldLexer * lexer,
+    int threadCnt)
+{
+    WorldBlockList list;
+    ThreadPool * pool;
+    int ok;
+    int i;
+
+    list.lexer = lexer;
+
+    if (! scanWorldBlocks(lexer, &list) ||
+        list.cnt < WORLD_PARALLEL_BLOCKS_MIN)
+    {
+        free(list.blocks);
+        return 0;
+    }
+
+    list.taskCnt = threadCnt * WORLD_TASKS_PER_THREAD;
+    list.names = (StringTable **)
+        malloc(list.taskCnt * sizeof(StringTable *));
+
+    pool = newThreadPool(threadCnt);
+    runThreadPool(pool, parseWorldBlocksTask, &list, list.taskCnt);
+    freeThreadPool(pool);
+
+    ok = 1;
+
+    for (i = 0; i < list.cnt; ++i)
+    {
+        ok = ok && ! list.blocks[i].mismatch;
+    }
+
+    if (ok)
+    {
+        mergeWorldBlocks(world, &list);
+    }
+    else
+    {
+        for (i = 0; i < list.cnt; ++i)
+        {
+            if (list.blocks[i].result != NULL)
+            {
+                freeBlock(list.blocks[i].type, list.blocks[i].result);
+            }
+        }
+    }
+
+    for (i = 0; i < list.taskCnt; ++i)
+    {
+        freeStringTable(list.names[i]);
+    }
+
+    free(list.names);
+    free(list.blocks);
+
+    return ok;
+}
+
+World * parseWorldThreads(const char * path, int threadCnt)
+{
+    WorldLexer * lexer = newWorldLexer(path);
+    World * world = newParsedWorld();
+
+    lexer->names = world->names;
+
+    if (threadCnt <= 0)
+    {
+        threadCnt = getProcessorsCount();
+    }
+
+    if (threadCnt == 1 ||
+        ! parseWorldBlocksParallel(world, lexer, threadCnt))
+    {
+        lexer->pos = lexer->text;
+        parseWorldBlocks(world, lexer);
+    }
+
+    freeWorldLexer(lexer);
+    resolveObjectMaterials(world);
+    return world;
+}
+
+World * parseWorld(const char * path)
+{
+    return parseWorldThreads(path, 0);
+}
+
+void freeParsedWorld(World * world)
+{
+    WorldObject * obj = world->objList.first;
+    Material * material = world->mtrlList.first;
+
+    while (obj != NULL)
+    {
+        WorldObject * next = obj->next;
+
+        /* Arrays of compiled world are in its file. */
+        if (world->binary == NULL)
+        {
+            free(obj->position);
+            free(obj->normal);
+            free(obj->texCoord);
+            free(obj->idx);
+        }
+
+        free(obj);
+        obj = next;
+    }
+
+    while (material != NULL)
+    {
+        Material * next = material->next;
+
+        free(material);
+        material = next;
+    }
+
+    freeNameIndex(&(world->mtrlList.index));
+    freeNameIndex(&(world->texList.index));
+    freeStringTable(world->names);
+    free(world->pointLight);
+
+    if (world->binary != NULL)
+    {
+        closeWorldBinary(world->binary);
+    }
+
+    free(world);
+}
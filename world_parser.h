@@ -0,0 +1,32 @@
+#ifndef WORLD_PARSER_H_SENTRY
+#define WORLD_PARSER_H_SENTRY
+
+#include "world_data.h"
+
+/* Reads world description (see world.txt) without OpenGL calls, so it
+ * works without context. Textures, buffers and shader program are set
+ * up by getWorld(). */
+World * parseWorld(const char * path);
+
+/* Top-level blocks are found by pre-scan and parsed by threadCnt threads
+ * (threadCnt <= 0 -- thread for each processor), then added in file
+ * order. Small worlds, threadCnt == 1 or text, which pre-scan can not
+ * split, are parsed by one thread. parseWorld() uses all processors. */
+World * parseWorldThreads(const char * path, int threadCnt);
+
+/* Empty world, for loaders. */
+World * newParsedWorld(void);
+
+/* Exit, if there is material with the same name. */
+void addMaterial(MaterialList * list, Material * material);
+
+void addWorldObject(WorldObjectList * list, WorldObject * object);
+
+/* Frees lists of world and world itself. */
+void freeParsedWorld(World * world);
+
+void copyVec3(WorldFloat * dst, const WorldFloat * src);
+
+void copyVec4(WorldFloat * dst, const WorldFloat * src);
+
+#endif /* WORLD_PARSER_H_SENTRY */
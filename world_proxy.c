@@ -0,0 +1,385 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "world_proxy.h"
+#include "shaders_errors.h"
+
+/* Buffer textures and texture array of proxy are bound to these units
+ * for all time. */
+#define WORLD_PROXY_NODES_UNIT 10
+#define WORLD_PROXY_TRIS_UNIT 11
+#define WORLD_PROXY_TEXTURE_UNIT 12
+
+/* Leaf node is not splitted further. */
+#define WORLD_PROXY_LEAF_TRIS 4
+
+#define WORLD_PROXY_TRI_FLOATS 16
+#define WORLD_PROXY_NODE_FLOATS 8
+
+typedef
+struct ProxyTriangle
+{
+    GLfloat p[3][3];
+    GLfloat tc[3][2];
+    GLfloat texture;
+
+    /* Sort key for split. */
+    GLfloat center[3];
+}
+ProxyTriangle;
+
+typedef
+struct ProxyBuilder
+{
+    ProxyTriangle * tris;
+    int triCnt;
+
+    GLfloat * nodes;
+    int nodeCnt;
+}
+ProxyBuilder;
+
+/* Axis of qsort() comparison. */
+static int sortAxis = 0;
+
+static int compareTriangles(const void * a, const void * b)
+{
+    GLfloat ca = ((const ProxyTriangle *) a)->center[sortAxis];
+    GLfloat cb = ((const ProxyTriangle *) b)->center[sortAxis];
+
+    return (ca < cb) ? -1 : ((ca > cb) ? 1 : 0);
+}
+
+/* Triangles of all objects with one of first textureCnt textures, other
+ * objects are not seen by rays. */
+static void collectTriangles(ProxyBuilder * builder, const World * world,
+    int textureCnt)
+{
+    const WorldObject * cur;
+    int i, j, k;
+
+    builder->triCnt = 0;
+
+    for (cur = world->objList.first; cur != NULL; cur = cur->next)
+    {
+        builder->triCnt += cur->idxCnt / 3;
+    }
+
+    builder->tris = (ProxyTriangle *)
+        malloc(builder->triCnt * sizeof(ProxyTriangle));
+    builder->triCnt = 0;
+
+    for (cur = world->objList.first; cur != NULL; cur = cur->next)
+    {
+        const Texture * texture = cur->material->texture;
+
+        if (cur->primitiveType != GL_TRIANGLES || texture == NULL ||
+            texture->num >= textureCnt)
+        {
+            continue;
+        }
+
+        for (i = 0; i + 2 < cur->idxCnt; i += 3)
+        {
+            ProxyTriangle * tri = builder->tris + builder->triCnt;
+
+            for (j = 0; j < 3; ++j)
+            {
+                GLuint v = cur->idx[i + j];
+
+                for (k = 0; k < 3; ++k)
+                {
+                    tri->p[j][k] = cur->position[3 * v + k];
+                }
+
+                tri->tc[j][0] = cur->texCoord[2 * v + 0];
+                tri->tc[j][1] = cur->texCoord[2 * v + 1];
+            }
+
+            for (k = 0; k < 3; ++k)
+            {
+                tri->center[k] =
+                    (tri->p[0][k] + tri->p[1][k] + tri->p[2][k]) / 3.0f;
+            }
+
+            tri->texture = (GLfloat) texture->num;
+            ++(builder->triCnt);
+        }
+    }
+}
+
+/* Node over triangles [first; first + cnt), children are splitted by
+ * median of triangle centers along the longest axis. */
+static void buildNode(ProxyBuilder * builder, int nodeIdx, int first,
+    int cnt, int depth)
+{
+    GLfloat * node = builder->nodes + nodeIdx * WORLD_PROXY_NODE_FLOATS;
+    GLfloat centerMin[3];
+    GLfloat centerMax[3];
+    int axis = 0;
+    int i, j, k;
+
+    if (depth >= WORLD_PROXY_STACK_MAX)
+    {
+        fprintf(stderr, "Too deep hierarchy of world proxy.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (k = 0; k < 3; ++k)
+    {
+        node[k] = node[4 + k] = builder->tris[first].p[0][k];
+        centerMin[k] = centerMax[k] = builder->tris[first].center[k];
+    }
+
+    for (i = first; i < first + cnt; ++i)
+    {
+        const ProxyTriangle * tri = builder->tris + i;
+
+        for (k = 0; k < 3; ++k)
+        {
+            for (j = 0; j < 3; ++j)
+            {
+                node[k] = (tri->p[j][k] < node[k]) ? tri->p[j][k] : node[k];
+                node[4 + k] = (tri->p[j][k] > node[4 + k]) ?
+                    tri->p[j][k] : node[4 + k];
+            }
+
+            centerMin[k] = (tri->center[k] < centerMin[k]) ?
+                tri->center[k] : centerMin[k];
+            centerMax[k] = (tri->center[k] > centerMax[k]) ?
+                tri->center[k] : centerMax[k];
+        }
+    }
+
+    if (cnt <= WORLD_PROXY_LEAF_TRIS)
+    {
+        node[3] = (GLfloat) first;
+        node[7] = (GLfloat) cnt;
+        return;
+    }
+
+    for (k = 1; k < 3; ++k)
+    {
+        if (centerMax[k] - centerMin[k] >
+            centerMax[axis] - centerMin[axis])
+        {
+            axis = k;
+        }
+    }
+
+    sortAxis = axis;
+    qsort(builder->tris + first, cnt, sizeof(ProxyTriangle),
+        compareTriangles);
+
+    /* Children are written after node is filled, builder->nodes is not
+     * reallocated. */
+    node[3] = (GLfloat) builder->nodeCnt;
+    node[7] = (GLfloat) -(axis + 1);
+    builder->nodeCnt += 2;
+
+    buildNode(builder, (int) node[3], first, cnt / 2, depth + 1);
+    buildNode(builder, (int) node[3] + 1, first + cnt / 2, cnt - cnt / 2,
+        depth + 1);
+}
+
+static void uploadBuffer(GLuint * tboP, GLuint * textureId,
+    const GLfloat * data, int floatCnt)
+{
+    glGenBuffers(1, tboP);
+    glBindBuffer(GL_TEXTURE_BUFFER, *tboP);
+    glBufferData(GL_TEXTURE_BUFFER, floatCnt * sizeof(GLfloat), data,
+        GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glGenTextures(1, textureId);
+    glBindTexture(GL_TEXTURE_BUFFER, *textureId);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, *tboP);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+/* Texture array with layer Texture->num for each of first layerCnt
+ * textures, they are resampled to WORLD_PROXY_TEXTURE_SIZE by blitting
+ * from level 0. Without textures array has one empty layer. */
+static GLuint createTextureArray(const World * world, int layerCnt)
+{
+    const Texture * cur;
+    GLuint fbos[2];
+    GLuint id;
+
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8,
+        WORLD_PROXY_TEXTURE_SIZE, WORLD_PROXY_TEXTURE_SIZE,
+        (layerCnt > 0) ? layerCnt : 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    glGenFramebuffers(2, fbos);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbos[0]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbos[1]);
+
+    for (cur = world->texList.first; cur != NULL; cur = cur->next)
+    {
+        GLint width, height;
+
+        if (cur->num >= layerCnt)
+        {
+            continue;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, cur->id);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH,
+            &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT,
+            &height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+            GL_TEXTURE_2D, cur->id, 0);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+            id, 0, cur->num);
+        glBlitFramebuffer(0, 0, width, height, 0, 0,
+            WORLD_PROXY_TEXTURE_SIZE, WORLD_PROXY_TEXTURE_SIZE,
+            GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(2, fbos);
+
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+        GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+
+    return id;
+}
+
+/* Names materials which objects are left out of the proxy. */
+static void warnExcludedMaterials(const World * world, int textureCnt)
+{
+    const Material * cur;
+
+    for (cur = world->mtrlList.first; cur != NULL; cur = cur->next)
+    {
+        if (cur->texture != NULL && cur->texture->num >= textureCnt)
+        {
+            fprintf(stderr, "Warning: objects of material \"%s\" are "
+                "not seen by rays of water (first %d textures only).\n",
+                cur->name, textureCnt);
+        }
+    }
+}
+
+WorldProxy * newWorldProxy(const World * world)
+{
+    WorldProxy * proxy = (WorldProxy *) malloc(sizeof(WorldProxy));
+    ProxyBuilder builder;
+    GLfloat * tris;
+    GLint layerMax;
+    int i, j;
+
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &layerMax);
+    proxy->textureCnt = (world->texList.cnt < layerMax) ?
+        world->texList.cnt : layerMax;
+    warnExcludedMaterials(world, proxy->textureCnt);
+
+    collectTriangles(&builder, world, proxy->textureCnt);
+
+    /* Binary tree with at least one triangle in each leaf. Without
+     * triangles root is empty leaf (no hit), buffers are not empty. */
+    builder.nodes = (GLfloat *) calloc(2 * builder.triCnt + 1,
+        WORLD_PROXY_NODE_FLOATS * sizeof(GLfloat));
+    builder.nodeCnt = 1;
+
+    if (builder.triCnt > 0)
+    {
+        buildNode(&builder, 0, 0, builder.triCnt, 0);
+    }
+
+    tris = (GLfloat *) calloc(builder.triCnt + 1,
+        WORLD_PROXY_TRI_FLOATS * sizeof(GLfloat));
+
+    for (i = 0; i < builder.triCnt; ++i)
+    {
+        const ProxyTriangle * tri = builder.tris + i;
+        GLfloat * dst = tris + i * WORLD_PROXY_TRI_FLOATS;
+
+        for (j = 0; j < 3; ++j)
+        {
+            dst[4 * j + 0] = tri->p[j][0];
+            dst[4 * j + 1] = tri->p[j][1];
+            dst[4 * j + 2] = tri->p[j][2];
+        }
+
+        dst[3] = tri->texture;
+        dst[7] = tri->tc[0][0];
+        dst[11] = tri->tc[0][1];
+        dst[12] = tri->tc[1][0];
+        dst[13] = tri->tc[1][1];
+        dst[14] = tri->tc[2][0];
+        dst[15] = tri->tc[2][1];
+    }
+
+    proxy->triCnt = builder.triCnt;
+    proxy->nodeCnt = builder.nodeCnt;
+
+    uploadBuffer(&(proxy->trisTboP), &(proxy->trisTextureId), tris,
+        (proxy->triCnt + 1) * WORLD_PROXY_TRI_FLOATS);
+    uploadBuffer(&(proxy->nodesTboP), &(proxy->nodesTextureId),
+        builder.nodes, proxy->nodeCnt * WORLD_PROXY_NODE_FLOATS);
+    proxy->texturesId = createTextureArray(world, proxy->textureCnt);
+
+    free(tris);
+    free(builder.tris);
+    free(builder.nodes);
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+
+    return proxy;
+}
+
+void setupWorldProxy(ShaderProgram * sp, const WorldProxy * proxy)
+{
+    GLint obj;
+
+    glUseProgram(sp->p);
+
+    glActiveTexture(GL_TEXTURE0 + WORLD_PROXY_NODES_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, proxy->nodesTextureId);
+
+    glActiveTexture(GL_TEXTURE0 + WORLD_PROXY_TRIS_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, proxy->trisTextureId);
+
+    glActiveTexture(GL_TEXTURE0 + WORLD_PROXY_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, proxy->texturesId);
+
+    glActiveTexture(GL_TEXTURE0);
+
+    obj = glGetUniformLocation(sp->p, "texProxyNodes");
+    /* TODO: if (obj == -1) {} */
+    glUniform1i(obj, WORLD_PROXY_NODES_UNIT);
+
+    obj = glGetUniformLocation(sp->p, "texProxyTris");
+    /* TODO: if (obj == -1) {} */
+    glUniform1i(obj, WORLD_PROXY_TRIS_UNIT);
+
+    obj = glGetUniformLocation(sp->p, "texWorld");
+    /* TODO: if (obj == -1) {} */
+    glUniform1i(obj, WORLD_PROXY_TEXTURE_UNIT);
+
+    CHECK_OPENGL_ERRORS(__FILE__, __LINE__);
+}
+
+void freeWorldProxy(WorldProxy * proxy)
+{
+    glDeleteTextures(1, &(proxy->trisTextureId));
+    glDeleteBuffers(1, &(proxy->trisTboP));
+    glDeleteTextures(1, &(proxy->nodesTextureId));
+    glDeleteBuffers(1, &(proxy->nodesTboP));
+    glDeleteTextures(1, &(proxy->texturesId));
+
+    free(proxy);
+}
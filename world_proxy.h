@@ -0,0 +1,50 @@
+#ifndef WORLD_PROXY_H_SENTRY
+#define WORLD_PROXY_H_SENTRY
+
+#include "world.h"
+#include "shaders.h"
+
+/* Triangles of world objects for rays of reflection and refraction in
+ * draw_water_fshader.glsl. They are made from World object list at load
+ * time and uploaded to buffer textures with bounding volume hierarchy
+ * (BVH) over them. World textures are resampled to one size into
+ * layers (Texture->num) of texture array. */
+
+/* Size of layers of texture array. */
+#define WORLD_PROXY_TEXTURE_SIZE 512
+
+/* Size of array in draw_water_fshader.glsl. */
+#define WORLD_PROXY_STACK_MAX 32
+
+typedef
+struct WorldProxy
+{
+    /* Each triangle is 4 texels: (p0, texture), (p1, tc0.s),
+     * (p2, tc0.t), (tc1, tc2). */
+    int triCnt;
+    GLuint trisTboP;
+    GLuint trisTextureId;
+
+    /* Each node is 2 texels: (min, a), (max, b) of its bounding box.
+     * Leaf (b >= 0): triangles [a; a + b). Inner node: children a and
+     * a + 1, splitted along axis -b - 1 (lower one first). Root is node
+     * 0, it is empty leaf, if there are no triangles. */
+    int nodeCnt;
+    GLuint nodesTboP;
+    GLuint nodesTextureId;
+
+    /* Objects with texture number textureCnt or more (more textures
+     * than GL_MAX_ARRAY_TEXTURE_LAYERS) are not in the proxy. */
+    int textureCnt;
+    GLuint texturesId;
+}
+WorldProxy;
+
+WorldProxy * newWorldProxy(const World * world);
+
+/* Binds buffer textures and texture array and sets samplers of sp. */
+void setupWorldProxy(ShaderProgram * sp, const WorldProxy * proxy);
+
+void freeWorldProxy(WorldProxy * proxy);
+
+#endif /* WORLD_PROXY_H_SENTRY */